@@ -0,0 +1,88 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+#include <queue>
+
+// Queue between two pipeline stages, push blocks while it is full
+// so that the producers can't run ahead of the consumers
+template <typename T>
+class BoundedQueue
+{
+public:
+	explicit BoundedQueue(size_t capacity)
+		: m_capacity(capacity)
+		, m_closed(false)
+	{}
+
+	// Blocks while the queue is full, returns false without queuing
+	// value once the queue is closed, the caller then drops it
+	bool push(T value)
+	{
+		{
+			std::unique_lock<std::mutex> lk(m_mutex);
+			m_not_full.wait(lk, [this] { return m_queue.size() < m_capacity || m_closed; });
+			if (m_closed) {
+				return false;
+			}
+			m_queue.push(std::move(value));
+		}
+		m_not_empty.notify_one();
+		return true;
+	}
+
+	// Blocks until a value is available, returns false once the queue is closed and drained
+	bool pop(T& value)
+	{
+		{
+			std::unique_lock<std::mutex> lk(m_mutex);
+			m_not_empty.wait(lk, [this] { return !m_queue.empty() || m_closed; });
+			if (m_queue.empty()) {
+				return false;
+			}
+			value = std::move(m_queue.front());
+			m_queue.pop();
+		}
+		m_not_full.notify_one();
+		return true;
+	}
+
+	// Wakes up the consumers and the producers waiting for room,
+	// no more values will be pushed
+	void close()
+	{
+		{
+			std::lock_guard<std::mutex> lk(m_mutex);
+			m_closed = true;
+		}
+		m_not_empty.notify_all();
+		m_not_full.notify_all();
+	}
+
+	size_t capacity() const { return m_capacity; }
+
+private:
+	std::mutex m_mutex;
+	std::condition_variable m_not_full;
+	std::condition_variable m_not_empty;
+	std::queue<T> m_queue;
+	size_t m_capacity;
+	bool m_closed;
+};
+
+// Closes a queue when going out of scope
+template <typename T>
+class QueueCloser
+{
+public:
+	explicit QueueCloser(BoundedQueue<T>& queue)
+		: m_queue(queue)
+	{}
+	~QueueCloser() { m_queue.close(); }
+
+	QueueCloser(const QueueCloser&) = delete;
+	QueueCloser& operator=(const QueueCloser&) = delete;
+
+private:
+	BoundedQueue<T>& m_queue;
+};
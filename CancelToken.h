@@ -0,0 +1,29 @@
+#pragma once
+
+#include <atomic>
+#include <stdexcept>
+
+// Set from the GUI thread, polled by the download threads
+class CancelToken
+{
+public:
+	CancelToken()
+		: m_cancelled(false)
+	{}
+
+	void cancel() { m_cancelled = true; }
+	void reset() { m_cancelled = false; }
+	bool cancelled() const { return m_cancelled; }
+
+private:
+	std::atomic<bool> m_cancelled;
+};
+
+// Thrown by the operations that noticed a cancellation
+class DownloadCancelled : public std::runtime_error
+{
+public:
+	DownloadCancelled()
+		: std::runtime_error("Download cancelled")
+	{}
+};
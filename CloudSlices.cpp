@@ -0,0 +1,209 @@
+#include <iterator>
+
+#include <ccLog.h>
+#include <ccScalarField.h>
+
+#include "CloudSlices.h"
+#include "PDALConverter.h"
+
+using mutex_locker = std::lock_guard<std::mutex>;
+
+CloudSlices::CloudSlices(ccPointCloud *cloud)
+	: m_cloud(cloud)
+	, m_used(cloud->size())
+	, m_capacity(cloud->size())
+{
+}
+
+bool
+CloudSlices::grow(const size_t capacity)
+{
+	QWriteLocker resize_lock(&m_resize_lock);
+	mutex_locker lk(m_mutex);
+	if (capacity <= m_capacity) {
+		return true;
+	}
+	if (!m_cloud->resize(static_cast<unsigned>(capacity))) {
+		return false;
+	}
+	m_capacity = capacity;
+	return true;
+}
+
+bool
+CloudSlices::acquire(const size_t count, unsigned& first_index)
+{
+	m_resize_lock.lockForRead();
+	{
+		mutex_locker lk(m_mutex);
+		if (m_used + count <= m_capacity) {
+			first_index = static_cast<unsigned>(m_used);
+			m_used += count;
+			return true;
+		}
+	}
+	m_resize_lock.unlock();
+	return false;
+}
+
+void
+CloudSlices::release()
+{
+	m_resize_lock.unlock();
+}
+
+void
+CloudSlices::discard(const unsigned first_index, const size_t count)
+{
+	mutex_locker lk(m_mutex);
+	if (!count) {
+		return;
+	}
+	if (first_index + count != m_used) {
+		m_holes[first_index] = count;
+		return;
+	}
+	m_used = first_index;
+	// Holes left just below go with it
+	while (!m_holes.empty()) {
+		const auto last = std::prev(m_holes.end());
+		if (last->first + last->second != m_used) {
+			break;
+		}
+		m_used = last->first;
+		m_holes.erase(last);
+	}
+}
+
+bool
+CloudSlices::add_fields_of(const ccPointCloud& src)
+{
+	QWriteLocker resize_lock(&m_resize_lock);
+	return add_missing_fields(src, m_cloud);
+}
+
+size_t
+CloudSlices::used() const
+{
+	mutex_locker lk(m_mutex);
+	return m_used;
+}
+
+size_t
+CloudSlices::capacity() const
+{
+	mutex_locker lk(m_mutex);
+	return m_capacity;
+}
+
+// Moves the points [begin, end) of cloud to to, with their colors and scalar fields
+static void
+move_points(ccPointCloud *cloud, const unsigned begin, const unsigned end, const unsigned to)
+{
+	for (unsigned i = begin; i < end; ++i) {
+		*point_slot(cloud, to + i - begin) = *cloud->getPoint(i);
+	}
+	if (cloud->hasColors()) {
+		for (unsigned i = begin; i < end; ++i) {
+			cloud->setPointColor(to + i - begin, cloud->getPointColor(i));
+		}
+	}
+	for (unsigned k = 0; k < cloud->getNumberOfScalarFields(); ++k) {
+		CCLib::ScalarField *sf = cloud->getScalarField(static_cast<int>(k));
+		for (unsigned i = begin; i < end; ++i) {
+			sf->setValue(to + i - begin, sf->getValue(i));
+		}
+	}
+}
+
+void
+CloudSlices::shrink_to_used()
+{
+	QWriteLocker resize_lock(&m_resize_lock);
+	mutex_locker lk(m_mutex);
+	if (!m_holes.empty()) {
+		unsigned to = m_holes.begin()->first;
+		for (auto hole = m_holes.begin(); hole != m_holes.end(); ++hole) {
+			const auto next = std::next(hole);
+			const unsigned begin = hole->first + static_cast<unsigned>(hole->second);
+			const unsigned end = next == m_holes.end() ? static_cast<unsigned>(m_used) : next->first;
+			move_points(m_cloud, begin, end, to);
+			to += end - begin;
+		}
+		m_used = to;
+	}
+	if (m_used < m_capacity && m_cloud->resize(static_cast<unsigned>(m_used))) {
+		m_capacity = m_used;
+	}
+}
+
+unsigned
+CloudSlices::compacted_index(const unsigned index) const
+{
+	mutex_locker lk(m_mutex);
+	size_t removed = 0;
+	for (const auto& hole : m_holes) {
+		if (hole.first >= index) {
+			break;
+		}
+		removed += hole.second;
+	}
+	return index - static_cast<unsigned>(removed);
+}
+
+bool
+add_missing_fields(const ccPointCloud& src, ccPointCloud *dst)
+{
+	if (src.hasColors() && !dst->hasColors()) {
+		if (!dst->resizeTheRGBTable(false)) {
+			ccLog::Error("Failed to allocate memory for the colors.");
+			return false;
+		}
+		dst->showColors(true);
+	}
+
+	for (unsigned k = 0; k < src.getNumberOfScalarFields(); ++k) {
+		const auto src_sf = static_cast<const ccScalarField*>(src.getScalarField(static_cast<int>(k)));
+		if (dst->getScalarFieldIndexByName(src_sf->getName()) >= 0) {
+			continue;
+		}
+		auto sf = new ccScalarField(src_sf->getName());
+		if (!sf->resize(dst->size())) {
+			ccLog::Error(QString("Failed to allocate memory for the scalar field %1").arg(sf->getName()));
+			sf->release();
+			return false;
+		}
+		sf->setGlobalShift(src_sf->getGlobalShift());
+		dst->addScalarField(sf);
+	}
+	return true;
+}
+
+void
+copy_into(const ccPointCloud& src, ccPointCloud *dst, const unsigned first_index)
+{
+	add_missing_fields(src, dst);
+
+	for (unsigned i = 0; i < src.size(); ++i) {
+		src.getPoint(i, *point_slot(dst, first_index + i));
+	}
+
+	if (src.hasColors() && dst->hasColors()) {
+		for (unsigned i = 0; i < src.size(); ++i) {
+			dst->setPointColor(first_index + i, src.getPointColor(i));
+		}
+	}
+
+	for (unsigned k = 0; k < src.getNumberOfScalarFields(); ++k) {
+		const auto src_sf = static_cast<const ccScalarField*>(src.getScalarField(static_cast<int>(k)));
+		const int dst_index = dst->getScalarFieldIndexByName(src_sf->getName());
+		if (dst_index < 0) {
+			continue;
+		}
+		const auto dst_sf = static_cast<ccScalarField*>(dst->getScalarField(dst_index));
+		const auto offset = static_cast<ScalarType>(src_sf->getGlobalShift() - dst_sf->getGlobalShift());
+		for (unsigned i = 0; i < src.size(); ++i) {
+			dst_sf->setValue(first_index + i, src_sf->getValue(i) + offset);
+		}
+	}
+}
\ No newline at end of file
@@ -0,0 +1,53 @@
+#pragma once
+
+#include <map>
+#include <mutex>
+
+#include <QReadWriteLock>
+
+#include <ccPointCloud.h>
+
+// Hands out disjoint ranges of a cloud sized ahead of time so that
+// workers can convert their tiles straight into it. The cloud is only
+// resized while no range is being written.
+class CloudSlices
+{
+public:
+	explicit CloudSlices(ccPointCloud *cloud);
+
+	// Resizes the cloud to hold at least capacity points
+	bool grow(size_t capacity);
+	// Reserves count points, on success [first_index, first_index + count)
+	// can be written until release() is called
+	bool acquire(size_t count, unsigned& first_index);
+	void release();
+	// Gives back a released range whose tile could not be written. The last range
+	// handed out is rolled back, the others stay holes until shrink_to_used()
+	void discard(unsigned first_index, size_t count);
+	// Adds the colors and scalar fields of src the cloud lacks, for all its points
+	bool add_fields_of(const ccPointCloud& src);
+
+	size_t used() const;
+	size_t capacity() const;
+	// Removes the discarded ranges, moving the points after them down,
+	// and gives back the capacity that was never handed out
+	void shrink_to_used();
+	// Where the point at index before shrink_to_used() is now
+	unsigned compacted_index(unsigned index) const;
+
+private:
+	ccPointCloud *m_cloud;
+	QReadWriteLock m_resize_lock;
+	mutable std::mutex m_mutex;
+	size_t m_used;
+	size_t m_capacity;
+	// Discarded ranges, by first index
+	std::map<unsigned, size_t> m_holes;
+};
+
+// Adds the colors and scalar fields of src that dst lacks, sized to the points of dst
+bool add_missing_fields(const ccPointCloud& src, ccPointCloud *dst);
+// Copies all the points of src into dst starting at first_index, matching scalar
+// fields by name and accounting for their global shifts. The colors and scalar
+// fields dst lacks are added first.
+void copy_into(const ccPointCloud& src, ccPointCloud *dst, unsigned first_index);
\ No newline at end of file
@@ -0,0 +1,151 @@
+#include <algorithm>
+
+#include <QThread>
+
+#include "ConcurrencyController.h"
+
+using mutex_locker = std::lock_guard<std::mutex>;
+
+ConcurrencyLimit::ConcurrencyLimit(const size_t initial, const size_t min, const size_t max)
+	: m_limit(std::min(std::max(initial, min), max))
+	, m_highest(m_limit)
+	, m_min(min)
+	, m_max(max)
+	, m_in_use(0)
+{
+}
+
+void
+ConcurrencyLimit::acquire()
+{
+	std::unique_lock<std::mutex> lk(m_mutex);
+	m_released.wait(lk, [this] { return m_in_use < m_limit; });
+	m_in_use++;
+}
+
+void
+ConcurrencyLimit::release()
+{
+	{
+		mutex_locker lk(m_mutex);
+		m_in_use--;
+	}
+	m_released.notify_one();
+}
+
+size_t
+ConcurrencyLimit::limit() const
+{
+	mutex_locker lk(m_mutex);
+	return m_limit;
+}
+
+size_t
+ConcurrencyLimit::max() const
+{
+	return m_max;
+}
+
+size_t
+ConcurrencyLimit::highest() const
+{
+	mutex_locker lk(m_mutex);
+	return m_highest;
+}
+
+void
+ConcurrencyLimit::set_limit(const size_t limit)
+{
+	bool raised;
+	{
+		mutex_locker lk(m_mutex);
+		const size_t new_limit = std::min(std::max(limit, m_min), m_max);
+		raised = new_limit > m_limit;
+		m_limit = new_limit;
+		m_highest = std::max(m_highest, m_limit);
+	}
+	if (raised) {
+		m_released.notify_all();
+	}
+}
+
+ConcurrencyController::ConcurrencyController(const size_t converters)
+	: m_fetch(4, 1, MaxFetches)
+	, m_convert(converters ? converters : core_count(), 1, converters ? converters : core_count())
+	, m_slow_start(true)
+	, m_backing_off(false)
+	, m_smoothed_latency(0)
+	, m_baseline_latency(0)
+	, m_round_left(m_fetch.limit())
+	, m_backoffs(0)
+{
+}
+
+void
+ConcurrencyController::fetch_succeeded(const double first_byte_seconds)
+{
+	mutex_locker lk(m_mutex);
+	m_smoothed_latency = m_smoothed_latency > 0 ? 0.8 * m_smoothed_latency + 0.2 * first_byte_seconds : first_byte_seconds;
+	if (m_baseline_latency <= 0 || m_smoothed_latency < m_baseline_latency) {
+		m_baseline_latency = m_smoothed_latency;
+	}
+
+	answered(m_smoothed_latency > LatencyTolerance * m_baseline_latency);
+}
+
+void
+ConcurrencyController::fetch_failed()
+{
+	mutex_locker lk(m_mutex);
+	answered(true);
+}
+
+size_t
+ConcurrencyController::backoffs() const
+{
+	mutex_locker lk(m_mutex);
+	return m_backoffs;
+}
+
+size_t
+ConcurrencyController::max_in_flight() const
+{
+	return m_fetch.limit() + 2 * m_convert.limit();
+}
+
+size_t
+ConcurrencyController::core_count()
+{
+	return static_cast<size_t>(std::max(QThread::idealThreadCount(), 1));
+}
+
+void
+ConcurrencyController::answered(const bool congested)
+{
+	if (congested && !m_backing_off) {
+		// The answers still in flight were sent under the old limit,
+		// they must not trigger another decrease
+		m_round_left = m_fetch.limit();
+		m_slow_start = false;
+		m_backing_off = true;
+		m_backoffs++;
+		m_fetch.set_limit(m_fetch.limit() / 2);
+		m_smoothed_latency = m_baseline_latency;
+		return;
+	}
+
+	if (!congested && m_slow_start) {
+		m_fetch.set_limit(m_fetch.limit() + 1);
+	}
+
+	if (m_round_left > 0 && --m_round_left > 0) {
+		return;
+	}
+	if (m_backing_off) {
+		m_backing_off = false;
+	}
+	else if (!m_slow_start) {
+		m_fetch.set_limit(m_fetch.limit() + 1);
+	}
+	m_round_left = m_fetch.limit();
+}
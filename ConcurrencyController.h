@@ -0,0 +1,97 @@
+#pragma once
+
+#include <condition_variable>
+#include <mutex>
+
+// A counting gate whose limit can change while it is in use
+class ConcurrencyLimit
+{
+public:
+	ConcurrencyLimit(size_t initial, size_t min, size_t max);
+
+	// Blocks until fewer than limit() holders are inside
+	void acquire();
+	void release();
+
+	size_t limit() const;
+	size_t max() const;
+	// Largest limit set so far
+	size_t highest() const;
+	// Clamps to [min, max]
+	void set_limit(size_t limit);
+
+private:
+	mutable std::mutex m_mutex;
+	std::condition_variable m_released;
+	size_t m_limit;
+	size_t m_highest;
+	size_t m_min;
+	size_t m_max;
+	size_t m_in_use;
+};
+
+class LimitGuard
+{
+public:
+	explicit LimitGuard(ConcurrencyLimit& limit)
+		: m_limit(limit)
+	{
+		m_limit.acquire();
+	}
+	~LimitGuard() { m_limit.release(); }
+
+	LimitGuard(const LimitGuard&) = delete;
+	LimitGuard& operator=(const LimitGuard&) = delete;
+
+private:
+	ConcurrencyLimit& m_limit;
+};
+
+// Tunes how many tiles are fetched at once with AIMD:
+// the limit grows by one per round of requests answered without trouble
+// (doubling per round until the first congestion) and is halved when
+// a request fails or the latency climbs well above the best seen so far.
+// Latency is the time to the first byte of a response, so that tiles
+// taking longer only because they are bigger are not seen as congestion.
+// Conversion is cpu bound and gets its own limit, the core count, which
+// stays fixed. What the fetch limit did ends up in the download stats.
+class ConcurrencyController
+{
+public:
+	static constexpr size_t MaxFetches = 64;
+	// Smoothed latency above this multiple of the baseline counts as congestion
+	static constexpr double LatencyTolerance = 2.0;
+
+	// converters is the number of conversion threads, 0 for one per core
+	explicit ConcurrencyController(size_t converters = 0);
+
+	ConcurrencyLimit& fetch() { return m_fetch; }
+	ConcurrencyLimit& convert() { return m_convert; }
+
+	// first_byte_seconds is the time until the response started coming in
+	void fetch_succeeded(double first_byte_seconds);
+	void fetch_failed();
+	// Times the fetch limit was halved so far
+	size_t backoffs() const;
+
+	// Tiles worth having in flight to keep both stages busy:
+	// the ones being fetched, waiting to be converted and being converted
+	size_t max_in_flight() const;
+
+private:
+	static size_t core_count();
+	// Called with m_mutex held for every answer to a fetch
+	void answered(bool congested);
+
+	ConcurrencyLimit m_fetch;
+	ConcurrencyLimit m_convert;
+
+	mutable std::mutex m_mutex;
+	bool m_slow_start;
+	bool m_backing_off;
+	double m_smoothed_latency;
+	double m_baseline_latency;
+	// Answers left before the end of the current round of requests
+	size_t m_round_left;
+	size_t m_backoffs;
+};
@@ -0,0 +1,367 @@
+#include "ConversionKernels.h"
+
+#include <algorithm>
+#include <atomic>
+
+#if defined(__x86_64__) || defined(_M_X64) || defined(__i386__) || defined(_M_IX86)
+#define QGH_X86_KERNELS
+#endif
+
+#ifdef QGH_X86_KERNELS
+#include <immintrin.h>
+#ifdef _MSC_VER
+#include <intrin.h>
+#define QGH_TARGET(isa)
+#else
+#define QGH_TARGET(isa) __attribute__((target(isa)))
+#endif
+#endif
+
+namespace Kernels {
+
+namespace scalar {
+
+void
+shift_and_narrow_xyz(const double *x, const double *y, const double *z, const size_t count, const double shift[3], float *out)
+{
+	for (size_t i = 0; i < count; ++i) {
+		out[3 * i] = static_cast<float>(x[i] - shift[0]);
+		out[3 * i + 1] = static_cast<float>(y[i] - shift[1]);
+		out[3 * i + 2] = static_cast<float>(z[i] - shift[2]);
+	}
+}
+
+void
+narrow_u16_to_u8(const uint16_t *in, const size_t count, const unsigned shift, uint8_t *out)
+{
+	for (size_t i = 0; i < count; ++i) {
+		out[i] = static_cast<uint8_t>(in[i] >> shift);
+	}
+}
+
+uint16_t
+narrow_u16_to_u8_max(const uint16_t *in, const size_t count, const unsigned shift, uint8_t *out)
+{
+	uint16_t max = 0;
+	for (size_t i = 0; i < count; ++i) {
+		max = std::max(max, in[i]);
+		out[i] = static_cast<uint8_t>(in[i] >> shift);
+	}
+	return max;
+}
+
+void
+shift_and_narrow(const double *in, const size_t count, const double shift, float *out)
+{
+	for (size_t i = 0; i < count; ++i) {
+		out[i] = static_cast<float>(in[i] - shift);
+	}
+}
+
+}
+
+#ifdef QGH_X86_KERNELS
+
+namespace avx2 {
+
+// Writes 4 points (x, y, z, garbage) with overlapping stores,
+// the caller must leave room for one more point after them.
+QGH_TARGET("avx2") static inline void
+store_xyz4(float *out, __m128 x, __m128 y, __m128 z)
+{
+	__m128 w = _mm_setzero_ps();
+	_MM_TRANSPOSE4_PS(x, y, z, w);
+	_mm_storeu_ps(out, x);
+	_mm_storeu_ps(out + 3, y);
+	_mm_storeu_ps(out + 6, z);
+	_mm_storeu_ps(out + 9, w);
+}
+
+QGH_TARGET("avx2") void
+shift_and_narrow_xyz(const double *x, const double *y, const double *z, const size_t count, const double shift[3], float *out)
+{
+	const __m256d sx = _mm256_set1_pd(shift[0]);
+	const __m256d sy = _mm256_set1_pd(shift[1]);
+	const __m256d sz = _mm256_set1_pd(shift[2]);
+
+	size_t i = 0;
+	for (; i + 5 <= count; i += 4) {
+		store_xyz4(out + 3 * i,
+			_mm256_cvtpd_ps(_mm256_sub_pd(_mm256_loadu_pd(x + i), sx)),
+			_mm256_cvtpd_ps(_mm256_sub_pd(_mm256_loadu_pd(y + i), sy)),
+			_mm256_cvtpd_ps(_mm256_sub_pd(_mm256_loadu_pd(z + i), sz))
+		);
+	}
+	scalar::shift_and_narrow_xyz(x + i, y + i, z + i, count - i, shift, out + 3 * i);
+}
+
+QGH_TARGET("avx2") void
+narrow_u16_to_u8(const uint16_t *in, const size_t count, const unsigned shift, uint8_t *out)
+{
+	const __m128i sh = _mm_cvtsi32_si128(static_cast<int>(shift));
+	const __m256i low_byte = _mm256_set1_epi16(0x00FF);
+
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		const __m256i a = _mm256_and_si256(_mm256_srl_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i)), sh), low_byte);
+		const __m256i b = _mm256_and_si256(_mm256_srl_epi16(_mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 16)), sh), low_byte);
+		// packus works per 128 bit lane, put the quarters back in order
+		const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+	}
+	scalar::narrow_u16_to_u8(in + i, count - i, shift, out + i);
+}
+
+QGH_TARGET("avx2") static inline uint16_t
+max_u16(__m128i v)
+{
+	alignas(16) uint16_t lanes[8];
+	_mm_store_si128(reinterpret_cast<__m128i*>(lanes), v);
+	return *std::max_element(lanes, lanes + 8);
+}
+
+QGH_TARGET("avx2") uint16_t
+narrow_u16_to_u8_max(const uint16_t *in, const size_t count, const unsigned shift, uint8_t *out)
+{
+	const __m128i sh = _mm_cvtsi32_si128(static_cast<int>(shift));
+	const __m256i low_byte = _mm256_set1_epi16(0x00FF);
+	__m256i max = _mm256_setzero_si256();
+
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		const __m256i in_a = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i));
+		const __m256i in_b = _mm256_loadu_si256(reinterpret_cast<const __m256i*>(in + i + 16));
+		max = _mm256_max_epu16(max, _mm256_max_epu16(in_a, in_b));
+		const __m256i a = _mm256_and_si256(_mm256_srl_epi16(in_a, sh), low_byte);
+		const __m256i b = _mm256_and_si256(_mm256_srl_epi16(in_b, sh), low_byte);
+		const __m256i packed = _mm256_permute4x64_epi64(_mm256_packus_epi16(a, b), 0xD8);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), packed);
+	}
+	const uint16_t tail = scalar::narrow_u16_to_u8_max(in + i, count - i, shift, out + i);
+	return std::max(tail, max_u16(_mm_max_epu16(_mm256_castsi256_si128(max), _mm256_extracti128_si256(max, 1))));
+}
+
+QGH_TARGET("avx2") void
+shift_and_narrow(const double *in, const size_t count, const double shift, float *out)
+{
+	const __m256d s = _mm256_set1_pd(shift);
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		_mm_storeu_ps(out + i, _mm256_cvtpd_ps(_mm256_sub_pd(_mm256_loadu_pd(in + i), s)));
+	}
+	scalar::shift_and_narrow(in + i, count - i, shift, out + i);
+}
+
+}
+
+namespace avx512 {
+
+// The unmasked conversions and extractions merge into an undefined vector,
+// which GCC reports as maybe uninitialized. Their masked forms with every
+// lane selected give the same result from an explicit zero source.
+QGH_TARGET("avx512f") static inline __m256
+narrow_pd(const __m512d v)
+{
+	return _mm512_mask_cvtpd_ps(_mm256_setzero_ps(), 0xFF, v);
+}
+
+QGH_TARGET("avx512bw") static inline __m256i
+narrow_epi16(const __m512i v)
+{
+	return _mm512_mask_cvtepi16_epi8(_mm256_setzero_si256(), 0xFFFFFFFF, v);
+}
+
+QGH_TARGET("avx512f") static inline __m256i
+low_half(const __m512i v)
+{
+	return _mm512_mask_extracti64x4_epi64(_mm256_setzero_si256(), 0xF, v, 0);
+}
+
+QGH_TARGET("avx512f") static inline __m256i
+high_half(const __m512i v)
+{
+	return _mm512_mask_extracti64x4_epi64(_mm256_setzero_si256(), 0xF, v, 1);
+}
+
+QGH_TARGET("avx512f") void
+shift_and_narrow_xyz(const double *x, const double *y, const double *z, const size_t count, const double shift[3], float *out)
+{
+	const __m512d sx = _mm512_set1_pd(shift[0]);
+	const __m512d sy = _mm512_set1_pd(shift[1]);
+	const __m512d sz = _mm512_set1_pd(shift[2]);
+
+	size_t i = 0;
+	for (; i + 9 <= count; i += 8) {
+		const __m256 fx = narrow_pd(_mm512_sub_pd(_mm512_loadu_pd(x + i), sx));
+		const __m256 fy = narrow_pd(_mm512_sub_pd(_mm512_loadu_pd(y + i), sy));
+		const __m256 fz = narrow_pd(_mm512_sub_pd(_mm512_loadu_pd(z + i), sz));
+		avx2::store_xyz4(out + 3 * i, _mm256_castps256_ps128(fx), _mm256_castps256_ps128(fy), _mm256_castps256_ps128(fz));
+		avx2::store_xyz4(out + 3 * (i + 4), _mm256_extractf128_ps(fx, 1), _mm256_extractf128_ps(fy, 1), _mm256_extractf128_ps(fz, 1));
+	}
+	scalar::shift_and_narrow_xyz(x + i, y + i, z + i, count - i, shift, out + 3 * i);
+}
+
+QGH_TARGET("avx512bw") void
+narrow_u16_to_u8(const uint16_t *in, const size_t count, const unsigned shift, uint8_t *out)
+{
+	const __m128i sh = _mm_cvtsi32_si128(static_cast<int>(shift));
+
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		const __m512i v = _mm512_srl_epi16(_mm512_loadu_si512(in + i), sh);
+		// truncating conversion, same as the static_cast of the scalar version
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), narrow_epi16(v));
+	}
+	scalar::narrow_u16_to_u8(in + i, count - i, shift, out + i);
+}
+
+QGH_TARGET("avx512bw") uint16_t
+narrow_u16_to_u8_max(const uint16_t *in, const size_t count, const unsigned shift, uint8_t *out)
+{
+	const __m128i sh = _mm_cvtsi32_si128(static_cast<int>(shift));
+	__m512i max = _mm512_setzero_si512();
+
+	size_t i = 0;
+	for (; i + 32 <= count; i += 32) {
+		const __m512i v = _mm512_loadu_si512(in + i);
+		max = _mm512_max_epu16(max, v);
+		_mm256_storeu_si256(reinterpret_cast<__m256i*>(out + i), narrow_epi16(_mm512_srl_epi16(v, sh)));
+	}
+	const uint16_t tail = scalar::narrow_u16_to_u8_max(in + i, count - i, shift, out + i);
+	const __m256i max_256 = _mm256_max_epu16(low_half(max), high_half(max));
+	return std::max(tail, avx2::max_u16(_mm_max_epu16(_mm256_castsi256_si128(max_256), _mm256_extracti128_si256(max_256, 1))));
+}
+
+QGH_TARGET("avx512f") void
+shift_and_narrow(const double *in, const size_t count, const double shift, float *out)
+{
+	const __m512d s = _mm512_set1_pd(shift);
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		_mm256_storeu_ps(out + i, narrow_pd(_mm512_sub_pd(_mm512_loadu_pd(in + i), s)));
+	}
+	scalar::shift_and_narrow(in + i, count - i, shift, out + i);
+}
+
+}
+
+#ifdef _MSC_VER
+static bool
+cpu_has(const int leaf, const int reg, const int bit)
+{
+	int info[4];
+	__cpuidex(info, leaf, 0);
+	return (info[reg] >> bit) & 1;
+}
+
+static Isa
+detect_isa()
+{
+	// The os must save the ymm (and zmm) registers on context switches
+	if (!cpu_has(1, 2, 27)) {
+		return Isa::Scalar;
+	}
+	const unsigned long long xcr0 = _xgetbv(0);
+	const bool avx2 = (xcr0 & 0x6) == 0x6 && cpu_has(7, 1, 5);
+	const bool avx512 = (xcr0 & 0xE6) == 0xE6 && cpu_has(7, 1, 16) && cpu_has(7, 1, 30);
+	return avx512 ? Isa::Avx512 : (avx2 ? Isa::Avx2 : Isa::Scalar);
+}
+#else
+static Isa
+detect_isa()
+{
+	__builtin_cpu_init();
+	if (__builtin_cpu_supports("avx512f") && __builtin_cpu_supports("avx512bw")) {
+		return Isa::Avx512;
+	}
+	if (__builtin_cpu_supports("avx2")) {
+		return Isa::Avx2;
+	}
+	return Isa::Scalar;
+}
+#endif
+
+#else
+
+static Isa
+detect_isa()
+{
+	return Isa::Scalar;
+}
+
+#endif
+
+Isa
+detected_isa()
+{
+	static const Isa isa = detect_isa();
+	return isa;
+}
+
+static std::atomic<Isa>&
+active()
+{
+	static std::atomic<Isa> isa(detected_isa());
+	return isa;
+}
+
+Isa
+active_isa()
+{
+	return active().load(std::memory_order_relaxed);
+}
+
+void
+set_active_isa(const Isa isa)
+{
+	active().store(static_cast<int>(isa) <= static_cast<int>(detected_isa()) ? isa : detected_isa());
+}
+
+const char*
+isa_name(const Isa isa)
+{
+	switch (isa)
+	{
+	case Isa::Avx512: return "AVX-512";
+	case Isa::Avx2: return "AVX2";
+	default: return "scalar";
+	}
+}
+
+#ifdef QGH_X86_KERNELS
+#define QGH_DISPATCH(fn, ...)                      \
+	switch (active_isa())                          \
+	{                                              \
+	case Isa::Avx512: return avx512::fn(__VA_ARGS__); \
+	case Isa::Avx2: return avx2::fn(__VA_ARGS__);  \
+	default: return scalar::fn(__VA_ARGS__);       \
+	}
+#else
+#define QGH_DISPATCH(fn, ...) return scalar::fn(__VA_ARGS__);
+#endif
+
+void
+shift_and_narrow_xyz(const double *x, const double *y, const double *z, const size_t count, const double shift[3], float *out)
+{
+	QGH_DISPATCH(shift_and_narrow_xyz, x, y, z, count, shift, out)
+}
+
+void
+narrow_u16_to_u8(const uint16_t *in, const size_t count, const unsigned shift, uint8_t *out)
+{
+	QGH_DISPATCH(narrow_u16_to_u8, in, count, shift, out)
+}
+
+uint16_t
+narrow_u16_to_u8_max(const uint16_t *in, const size_t count, const unsigned shift, uint8_t *out)
+{
+	QGH_DISPATCH(narrow_u16_to_u8_max, in, count, shift, out)
+}
+
+void
+shift_and_narrow(const double *in, const size_t count, const double shift, float *out)
+{
+	QGH_DISPATCH(shift_and_narrow, in, count, shift, out)
+}
+
+}
\ No newline at end of file
@@ -0,0 +1,36 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+
+// Data-parallel loops used by PDALConverter.
+// Each kernel has a scalar version and, on x86, AVX2 and AVX-512 versions
+// picked at runtime. All versions give bit-identical results.
+namespace Kernels {
+
+	enum class Isa
+	{
+		Scalar,
+		Avx2,
+		Avx512
+	};
+
+	// Best instruction set supported by the running cpu
+	Isa detected_isa();
+	// Instruction set actually used, defaults to detected_isa()
+	Isa active_isa();
+	// Forces the instruction set, capped at detected_isa()
+	void set_active_isa(Isa isa);
+	const char* isa_name(Isa isa);
+
+	// out[3 * i + k] = float(in_k[i] - shift[k]) for the x, y and z columns
+	void shift_and_narrow_xyz(const double *x, const double *y, const double *z, size_t count, const double shift[3], float *out);
+
+	// out[i] = uint8_t(in[i] >> shift)
+	void narrow_u16_to_u8(const uint16_t *in, size_t count, unsigned shift, uint8_t *out);
+	// Same, also returning the largest input
+	uint16_t narrow_u16_to_u8_max(const uint16_t *in, size_t count, unsigned shift, uint8_t *out);
+
+	// out[i] = float(in[i] - shift)
+	void shift_and_narrow(const double *in, size_t count, double shift, float *out);
+}
\ No newline at end of file
@@ -0,0 +1,30 @@
+#pragma once
+
+#include <functional>
+
+#include <ccCustomObject.h>
+
+// Calls back when one of the DB objects it watches is deleted, for the code
+// keeping pointers to objects the user may delete from the DB tree meanwhile.
+// Relies on cc's dependency notifications, the watcher is never added to the DB.
+class DeletionWatcher : public ccCustomHObject
+{
+public:
+	explicit DeletionWatcher(std::function<void(const ccHObject*)> deleted)
+		: ccCustomHObject("deletion watcher")
+		, m_deleted(std::move(deleted))
+	{}
+
+	void watch(ccHObject *object) { object->addDependency(this, DP_NOTIFY_OTHER_ON_DELETE); }
+	void unwatch(ccHObject *object) { object->removeDependencyWith(this); }
+
+protected:
+	void onDeletionOf(const ccHObject *object) override
+	{
+		ccCustomHObject::onDeletionOf(object);
+		m_deleted(object);
+	}
+
+private:
+	std::function<void(const ccHObject*)> m_deleted;
+};
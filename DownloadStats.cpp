@@ -0,0 +1,168 @@
+#include <QFile>
+#include <QJsonDocument>
+
+#include <ccLog.h>
+
+#include "DownloadStats.h"
+
+#ifdef _WIN32
+#ifndef NOMINMAX
+#define NOMINMAX
+#endif
+#include <windows.h>
+#include <psapi.h>
+#ifdef _MSC_VER
+#pragma comment(lib, "psapi.lib")
+#endif
+#else
+#include <sys/resource.h>
+#include <time.h>
+#endif
+
+double
+thread_cpu_seconds()
+{
+#ifdef _WIN32
+	FILETIME creation, exit, kernel, user;
+	if (!GetThreadTimes(GetCurrentThread(), &creation, &exit, &kernel, &user)) {
+		return 0;
+	}
+	const auto to_100ns = [](const FILETIME& t) {
+		return (static_cast<unsigned long long>(t.dwHighDateTime) << 32) | t.dwLowDateTime;
+	};
+	return static_cast<double>(to_100ns(kernel) + to_100ns(user)) * 1e-7;
+#else
+	timespec ts;
+	if (clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) != 0) {
+		return 0;
+	}
+	return static_cast<double>(ts.tv_sec) + static_cast<double>(ts.tv_nsec) * 1e-9;
+#endif
+}
+
+size_t
+process_peak_rss_bytes()
+{
+#ifdef _WIN32
+	PROCESS_MEMORY_COUNTERS counters;
+	if (!GetProcessMemoryInfo(GetCurrentProcess(), &counters, sizeof(counters))) {
+		return 0;
+	}
+	return counters.PeakWorkingSetSize;
+#else
+	rusage usage;
+	if (getrusage(RUSAGE_SELF, &usage) != 0) {
+		return 0;
+	}
+#ifdef __APPLE__
+	return static_cast<size_t>(usage.ru_maxrss);
+#else
+	// Linux gives kilobytes
+	return static_cast<size_t>(usage.ru_maxrss) * 1024;
+#endif
+#endif
+}
+
+QString
+DownloadStats::summary() const
+{
+	QString text = QString("[qGreyhound] Downloaded %1 points in %2 tiles (%3 failed) in %4 s, coordinator cpu time %5 s")
+		.arg(points)
+		.arg(tiles)
+		.arg(failed_tiles)
+		.arg(wall_seconds, 0, 'f', 2)
+		.arg(coordinator_cpu_seconds, 0, 'f', 3);
+	if (bytes) {
+		text += QString(", %1 MiB transferred%2").arg(bytes / double(1 << 20), 0, 'f', 1).arg(compressed ? " compressed" : "");
+	}
+	if (decode_seconds > 0 && decoded_bytes) {
+		text += QString(", %1 %2 MiB at %3 MiB/s per thread")
+			.arg(compressed ? "decompressed" : "decoded")
+			.arg(decoded_bytes / double(1 << 20), 0, 'f', 1)
+			.arg(decoded_bytes / double(1 << 20) / decode_seconds, 0, 'f', 1);
+	}
+	if (fetch_limit_highest) {
+		text += QString(", up to %1 fetches at once (%2 backoffs)").arg(fetch_limit_highest).arg(fetch_backoffs);
+	}
+	if (stopped_tiles) {
+		text += QString(", %1 tiles left out by the stop criteria").arg(stopped_tiles);
+	}
+	if (budget_reached) {
+		text += QString(", stopped by the memory budget of %1").arg(budget_limit.isEmpty() ? "the download" : budget_limit);
+	}
+	else if (cancelled) {
+		text += ", cancelled";
+	}
+	if (skipped_tiles) {
+		text += QString(", %1 tiles skipped").arg(skipped_tiles);
+	}
+	return text;
+}
+
+QJsonObject
+DownloadStats::to_json() const
+{
+	const auto per_second = [this](const double amount) {
+		return wall_seconds > 0 ? amount / wall_seconds : 0.0;
+	};
+
+	QJsonObject json;
+	json["tiles"] = static_cast<double>(tiles);
+	json["failed_tiles"] = static_cast<double>(failed_tiles);
+	json["skipped_tiles"] = static_cast<double>(skipped_tiles);
+	json["stopped_tiles"] = static_cast<double>(stopped_tiles);
+	json["points"] = static_cast<double>(points);
+	json["bytes"] = static_cast<double>(bytes);
+	json["decoded_bytes"] = static_cast<double>(decoded_bytes);
+	json["compressed"] = compressed;
+	json["wall_seconds"] = wall_seconds;
+	json["first_points_seconds"] = first_points_seconds;
+	json["coordinator_cpu_seconds"] = coordinator_cpu_seconds;
+	json["decode_seconds"] = decode_seconds;
+	json["points_per_second"] = per_second(static_cast<double>(points));
+	json["bytes_per_second"] = per_second(static_cast<double>(bytes));
+	json["peak_rss_bytes"] = static_cast<double>(peak_rss_bytes);
+	json["converter_threads"] = static_cast<double>(converter_threads);
+	json["fetch_limit_highest"] = static_cast<double>(fetch_limit_highest);
+	json["fetch_backoffs"] = static_cast<double>(fetch_backoffs);
+	json["budget_reached"] = budget_reached;
+	json["budget_limit"] = budget_limit;
+	json["cancelled"] = cancelled;
+	return json;
+}
+
+CoordinatorTimer::CoordinatorTimer()
+	: m_wall_start(std::chrono::steady_clock::now())
+	, m_cpu_start(thread_cpu_seconds())
+{
+}
+
+double
+CoordinatorTimer::elapsed() const
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - m_wall_start).count();
+}
+
+void
+CoordinatorTimer::stop(DownloadStats& stats) const
+{
+	stats.wall_seconds = elapsed();
+	stats.coordinator_cpu_seconds = thread_cpu_seconds() - m_cpu_start;
+	stats.peak_rss_bytes = process_peak_rss_bytes();
+}
+
+void
+publish_report(const QJsonObject& report)
+{
+	const QString path = QString::fromLocal8Bit(qgetenv("QGREYHOUND_REPORT"));
+	if (path.isEmpty()) {
+		return;
+	}
+	QFile file(path);
+	if (file.open(QIODevice::WriteOnly | QIODevice::Append)) {
+		file.write(QJsonDocument(report).toJson(QJsonDocument::Compact) + '\n');
+	}
+	else {
+		ccLog::Warning(QString("[qGreyhound] could not append the report to %1").arg(path));
+	}
+}
\ No newline at end of file
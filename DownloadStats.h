@@ -0,0 +1,82 @@
+#pragma once
+
+#include <chrono>
+
+#include <QJsonObject>
+#include <QString>
+
+// CPU time consumed so far by the calling thread, in seconds
+double thread_cpu_seconds();
+// Largest resident set of the process so far, 0 if unknown
+size_t process_peak_rss_bytes();
+
+struct DownloadStats
+{
+	DownloadStats()
+		: tiles(0)
+		, failed_tiles(0)
+		, skipped_tiles(0)
+		, stopped_tiles(0)
+		, points(0)
+		, bytes(0)
+		, decoded_bytes(0)
+		, decode_seconds(0)
+		, compressed(false)
+		, wall_seconds(0)
+		, first_points_seconds(-1)
+		, coordinator_cpu_seconds(0)
+		, peak_rss_bytes(0)
+		, converter_threads(0)
+		, fetch_limit_highest(0)
+		, fetch_backoffs(0)
+		, budget_reached(false)
+		, cancelled(false)
+	{}
+
+	QString summary() const;
+	// Everything above plus the rates, for tools comparing runs
+	QJsonObject to_json() const;
+
+	size_t tiles;
+	size_t failed_tiles;
+	size_t skipped_tiles;
+	// Not requested because a stop criterion was met
+	size_t stopped_tiles;
+	size_t points;
+	// Received from the network, compressed or not
+	size_t bytes;
+	// Size of the decoded points and time the converters spent decoding them
+	size_t decoded_bytes;
+	double decode_seconds;
+	bool compressed;
+	double wall_seconds;
+	// Until the first tile was in the cloud, -1 if none was
+	double first_points_seconds;
+	double coordinator_cpu_seconds;
+	size_t peak_rss_bytes;
+	size_t converter_threads;
+	// Most fetches the concurrency controller allowed at once, and how often it halved them
+	size_t fetch_limit_highest;
+	size_t fetch_backoffs;
+	bool budget_reached;
+	// The limit of the memory budget that stopped the download, like "512 MiB"
+	QString budget_limit;
+	bool cancelled;
+};
+
+// Measures the wall and cpu time of the thread coordinating a download
+class CoordinatorTimer
+{
+public:
+	CoordinatorTimer();
+	double elapsed() const;
+	void stop(DownloadStats& stats) const;
+
+private:
+	std::chrono::steady_clock::time_point m_wall_start;
+	double m_cpu_start;
+};
+
+// Appends report as one line of json to the file the QGREYHOUND_REPORT
+// environment variable names, if set. The console only gets the summary.
+void publish_report(const QJsonObject& report);
\ No newline at end of file
@@ -2,35 +2,173 @@
 #include <QEventLoop>
 #include <QtConcurrent>
 #include <QThreadPool>
+#include <QJsonArray>
 
-#include <DgmOctree.h>
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cmath>
+#include <condition_variable>
+#include <iterator>
+#include <limits>
+#include <mutex>
+#include <queue>
 
-#include <GreyhoundReader.hpp>
+#include <DgmOctree.h>
 
 #include "GreyhoundDownloader.h"
+#include "BoundedQueue.h"
+#include "CloudSlices.h"
+#include "ConcurrencyController.h"
+#include "DownloadStats.h"
+#include "GreyhoundRead.h"
 
-void
-download_and_convert_cloud(ccPointCloud *cloud, const pdal::Options& opts, PDALConverter converter)
+static TraceTile
+trace_tile(const pdal::greyhound::Bounds& b, const int depth)
 {
-	std::exception_ptr eptr(nullptr);
+	TraceTile tile;
+	tile.depth = depth;
+	const double bounds[6] = { b.min().x, b.min().y, b.min().z, b.max().x, b.max().y, b.max().z };
+	std::copy(std::begin(bounds), std::end(bounds), tile.bounds);
+	return tile;
+}
+
+int
+download_and_convert_tile(ccPointCloud *cloud, const GreyhoundRead& read, const pdal::Options& opts, const pdal::greyhound::Bounds& b,
+	const int depth_begin, const int depth_end, PDALConverter converter, TileCache *cache, const CancelToken *cancel, TileTrace *trace)
+{
+	const TraceTile tile = trace ? trace_tile(b, depth_begin) : TraceTile();
+	int color_shift = 0;
+	if (cache) {
+		TracePhase phase(trace, "cache_load", tile);
+		if (cache->load(opts, converter, cloud, &color_shift)) {
+			phase.tile.points = cloud->size();
+			return color_shift;
+		}
+	}
+	const CloudMark before(*cloud);
+
+	std::vector<char> response;
+	{
+		TracePhase phase(trace, "http", tile);
+		response = read.fetch(b, depth_begin, depth_end, cancel);
+		phase.tile.bytes = response.size();
+	}
 	pdal::PointTable table;
-	pdal::GreyhoundReader reader;
+	pdal::PointViewPtr view;
+	{
+		TracePhase phase(trace, "decode", tile);
+		view = read.decode(response, table);
+		phase.tile.points = view->size();
+	}
+	{
+		TracePhase phase(trace, "convert", tile);
+		phase.tile.points = view->size();
+		color_shift = converter.convert(view, table.layout(), cloud);
+	}
+
+	if (cache) {
+		TracePhase phase(trace, "cache_store", tile);
+		cache->store(opts, converter, color_shift, *cloud, before);
+	}
+	return color_shift;
+}
 
-	reader.addOptions(opts);
+int
+download_and_convert_tile_threaded(ccPointCloud *cloud, const GreyhoundRead& read, const pdal::Options& opts, const pdal::greyhound::Bounds& b,
+	const int depth_begin, const int depth_end, const PDALConverter converter, TileCache *cache, TileTrace *trace)
+{
+	std::exception_ptr eptr(nullptr);
+	int color_shift = 0;
+	const auto dl = [&]() {
+		try {
+			color_shift = download_and_convert_tile(cloud, read, opts, b, depth_begin, depth_end, converter, cache, nullptr, trace);
+		}
+		catch (...) {
+			eptr = std::current_exception();
+		}
+	};
+
+	QFutureWatcher<void> downloader;
+	QEventLoop loop;
+	downloader.setFuture(QtConcurrent::run(dl));
+	QObject::connect(&downloader, &QFutureWatcher<void>::finished, &loop, &QEventLoop::quit);
+	loop.exec();
+	downloader.waitForFinished();
 
-	reader.prepare(table);
-	pdal::PointViewSet view_set = reader.execute(table);
-	const pdal::PointViewPtr view_ptr = *view_set.begin();
-	converter.convert(view_ptr, table.layout(), cloud);
+	if (eptr) {
+		std::rethrow_exception(eptr);
+	}
+	return color_shift;
+}
+
+Json::Value
+dimension_names(const pdal::Options& opts)
+{
+	Json::Value dims;
+	Json::Reader reader;
+	reader.parse(opts.getValueOrDefault<std::string>("dims", "[]"), dims, false);
+	return dims;
 }
 
 void
-download_and_convert_cloud_threaded(ccPointCloud *cloud, const pdal::Options& opts, const PDALConverter converter)
+download_dimensions(ccGreyhoundCloud *cloud, const std::string& url, const std::vector<GreyhoundDimension>& schema, const Json::Value& dims)
+{
+	std::vector<TileRange> tiles(cloud->tiles());
+	if (tiles.empty()) {
+		throw std::runtime_error("The cloud does not know which tiles it was built from");
+	}
+
+	const GreyhoundRead read(url, schema, dims, false);
+	PDALConverter converter;
+	converter.set_parallel(false);
+	const auto download_tile = [&read, &converter, cloud](const TileRange& tile, const bool prepare) {
+		pdal::PointTable table;
+		const pdal::PointViewPtr view = read.decode(read.fetch(tile.b, tile.depth_begin, tile.depth_end), table);
+		if (view->size() != tile.count) {
+			throw std::runtime_error("A tile came back with " + std::to_string(view->size()) + " points instead of " + std::to_string(tile.count));
+		}
+		if (prepare && !PDALConverter::prepare_into(view, table.layout(), cloud)) {
+			throw std::runtime_error("Failed to allocate memory for the new dimensions");
+		}
+		converter.convert_into(view, table.layout(), cloud, tile.first_index);
+	};
+
+	// The first tile creates the scalar fields, the others only fill their own range
+	download_tile(tiles.front(), true);
+
+	std::mutex mu_error;
+	std::string error;
+	QtConcurrent::blockingMap(tiles.begin() + 1, tiles.end(), [&](const TileRange& tile) {
+		try {
+			download_tile(tile, false);
+		}
+		catch (const std::exception& e) {
+			std::lock_guard<std::mutex> lk(mu_error);
+			if (error.empty()) {
+				error = e.what();
+			}
+		}
+	});
+
+	for (const auto& name : dims) {
+		const int sf_index = cloud->getScalarFieldIndexByName(name.asCString());
+		if (sf_index >= 0) {
+			cloud->getScalarField(sf_index)->computeMinAndMax();
+		}
+	}
+	if (!error.empty()) {
+		throw std::runtime_error(error);
+	}
+}
+
+void
+download_dimensions_threaded(ccGreyhoundCloud *cloud, const std::string& url, const std::vector<GreyhoundDimension>& schema, const Json::Value& dims)
 {
 	std::exception_ptr eptr(nullptr);
-	const auto dl = [&cloud, &eptr](const pdal::Options opts, const PDALConverter converter) {
+	const auto dl = [cloud, &url, &schema, &dims, &eptr]() {
 		try {
-			download_and_convert_cloud(cloud, opts, converter);
+			download_dimensions(cloud, url, schema, dims);
 		}
 		catch (...) {
 			eptr = std::current_exception();
@@ -39,7 +177,7 @@ download_and_convert_cloud_threaded(ccPointCloud *cloud, const pdal::Options& op
 
 	QFutureWatcher<void> downloader;
 	QEventLoop loop;
-	downloader.setFuture(QtConcurrent::run(dl, opts, converter));
+	downloader.setFuture(QtConcurrent::run(dl));
 	QObject::connect(&downloader, &QFutureWatcher<void>::finished, &loop, &QEventLoop::quit);
 	loop.exec();
 	downloader.waitForFinished();
@@ -49,12 +187,30 @@ download_and_convert_cloud_threaded(ccPointCloud *cloud, const pdal::Options& op
 	}
 }
 
-GreyhoundDownloader::GreyhoundDownloader(const pdal::Options& opts, const uint32_t start_depth, const pdal::greyhound::Bounds bounds, const PDALConverter converter)
+GreyhoundDownloader::GreyhoundDownloader(const pdal::Options& opts, const std::vector<GreyhoundDimension>& schema, const uint32_t start_depth, const pdal::greyhound::Bounds bounds, const PDALConverter converter)
 	: m_opts(opts)
 	, m_current_depth(start_depth)
 	, m_bounds(bounds)
 	, m_converter(converter)
+	, m_read(opts.getValueOrThrow<std::string>("url"), schema, dimension_names(opts))
+	, m_target_tile_bytes(TargetTileBytes)
+	, m_target_tile_points(0)
+	, m_converter_threads(0)
 {
+	const CCVector3d center((bounds.min().x + bounds.max().x) / 2, (bounds.min().y + bounds.max().y) / 2, (bounds.min().z + bounds.max().z) / 2);
+	const double half_diagonal = std::hypot(bounds.max().x - bounds.min().x, bounds.max().y - bounds.min().y) / 2;
+	m_priority = default_tile_priority(center, half_diagonal);
+}
+
+size_t
+bytes_per_point(const ccPointCloud& cloud)
+{
+	size_t bytes = sizeof(CCVector3);
+	if (cloud.hasColors()) {
+		bytes += 3 * sizeof(ColorCompType);
+	}
+	bytes += cloud.getNumberOfScalarFields() * sizeof(ScalarType);
+	return bytes;
 }
 
 class DlWorker : public QRunnable
@@ -80,93 +236,707 @@ void DlWorker::run()
 	m_f(m);
 }
 
+constexpr uint64_t ChildTile::UnknownPoints;
+
+static const char*
+method_name(const GreyhoundDownloader::DownloadMethod method)
+{
+	switch (method)
+	{
+	case GreyhoundDownloader::DownloadMethod::DepthByDepth: return "depth_by_depth";
+	case GreyhoundDownloader::DownloadMethod::Quadtree: return "quadtree";
+	case GreyhoundDownloader::DownloadMethod::Octree: return "octree";
+	default: return "unknown";
+	}
+}
+
+// How the hierarchy folds the tiles of a download method
+static HierarchyIndex::Split
+split_of(const GreyhoundDownloader::DownloadMethod method)
+{
+	switch (method)
+	{
+	case GreyhoundDownloader::DownloadMethod::Quadtree:
+		return HierarchyIndex::Split::Quadtree;
+	case GreyhoundDownloader::DownloadMethod::Octree:
+		return HierarchyIndex::Split::Octree;
+	default:
+		return HierarchyIndex::Split::Flat;
+	}
+}
+
+std::vector<ChildTile>
+GreyhoundDownloader::children_of(const pdal::greyhound::Bounds& b, const int depth, const DownloadMethod method, const bool with_counts) const
+{
+	std::vector<ChildTile> children;
+	switch (method)
+	{
+	case DownloadMethod::DepthByDepth:
+		children.push_back({ b, ChildTile::UnknownPoints });
+		break;
+	case DownloadMethod::Quadtree:
+		children.push_back({ b.getSe(), ChildTile::UnknownPoints });
+		children.push_back({ b.getSw(), ChildTile::UnknownPoints });
+		children.push_back({ b.getNe(), ChildTile::UnknownPoints });
+		children.push_back({ b.getNw(), ChildTile::UnknownPoints });
+		break;
+	case DownloadMethod::Octree:
+		for (size_t i = 0; i < OctantKeys.size(); ++i) {
+			children.push_back({ octant_bounds(b, static_cast<Octant>(i)), ChildTile::UnknownPoints });
+		}
+		break;
+	default:
+		break;
+	}
+
+	if (with_counts && m_hierarchy) {
+		try {
+			for (auto& child : children) {
+				child.points = m_hierarchy->points(child.b, depth + 1);
+			}
+			if (m_target_tile_points) {
+				children = sized_tiles(std::move(children), b, depth + 1, method);
+			}
+		}
+		catch (const std::exception& e) {
+			// Without the hierarchy we can't tell, so visit everything
+			ccLog::Print(QString("[qGreyhound] hierarchy: %1").arg(e.what()));
+			for (auto& child : children) {
+				child.points = ChildTile::UnknownPoints;
+			}
+		}
+	}
+
+	children.erase(std::remove_if(children.begin(), children.end(), [](const ChildTile& c) { return c.points == 0; }), children.end());
+	return children;
+}
+
+std::vector<ChildTile>
+GreyhoundDownloader::sized_tiles(std::vector<ChildTile> tiles, const pdal::greyhound::Bounds& parent, const int depth, const DownloadMethod method) const
+{
+	const bool known = std::none_of(tiles.begin(), tiles.end(), [](const ChildTile& t) { return t.points == ChildTile::UnknownPoints; });
+	if (tiles.size() > 1 && known) {
+		uint64_t total = 0;
+		for (const auto& tile : tiles) {
+			total += tile.points;
+		}
+		if (total <= m_target_tile_points) {
+			// One request for the whole parent at depth
+			return { { parent, total } };
+		}
+	}
+
+	std::vector<ChildTile> sized;
+	for (const auto& tile : tiles) {
+		split_dense(tile, depth, method, 0, sized);
+	}
+	return sized;
+}
+
+void
+GreyhoundDownloader::split_dense(const ChildTile& tile, const int depth, const DownloadMethod method, const int splits, std::vector<ChildTile>& out) const
+{
+	if (tile.points == ChildTile::UnknownPoints || tile.points <= m_target_tile_points || splits == MaxTileSplits) {
+		out.push_back(tile);
+		return;
+	}
+
+	std::vector<pdal::greyhound::Bounds> parts;
+	if (method == DownloadMethod::Octree) {
+		for (size_t i = 0; i < OctantKeys.size(); ++i) {
+			parts.push_back(octant_bounds(tile.b, static_cast<Octant>(i)));
+		}
+	}
+	else {
+		parts = { tile.b.getSe(), tile.b.getSw(), tile.b.getNe(), tile.b.getNw() };
+	}
+	for (const auto& part : parts) {
+		split_dense({ part, m_hierarchy->points(part, depth) }, depth, method, splits + 1, out);
+	}
+}
+
+// Ground area covered by b
+static double
+area(const pdal::greyhound::Bounds& b)
+{
+	return (b.max().x - b.min().x) * (b.max().y - b.min().y);
+}
+
+// Space covered by b
+static double
+volume(const pdal::greyhound::Bounds& b)
+{
+	return area(b) * (b.max().z - b.min().z);
+}
+
+// Part of parent's points that fall in child, assuming they are spread evenly
+static double
+share_of(const pdal::greyhound::Bounds& child, const pdal::greyhound::Bounds& parent, const GreyhoundDownloader::DownloadMethod method)
+{
+	if (method == GreyhoundDownloader::DownloadMethod::Octree) {
+		return volume(parent) > 0 ? volume(child) / volume(parent) : 1.0;
+	}
+	return area(parent) > 0 ? area(child) / area(parent) : 1.0;
+}
+
+TilePriority
+default_tile_priority(const CCVector3d focus, const double scale)
+{
+	return [focus, scale](const BoundsDepth& tile) {
+		const auto& b = tile.b;
+		const CCVector3d center((b.min().x + b.max().x) / 2, (b.min().y + b.max().y) / 2, (b.min().z + b.max().z) / 2);
+		// Only the horizontal distance, 2d tiles have no meaningful z
+		const double dx = center.x - focus.x;
+		const double dy = center.y - focus.y;
+		const double closeness = scale > 0 ? 1.0 - std::min(std::sqrt(dx * dx + dy * dy) / scale, 1.0) : 0.0;
+		// Unknown counts rank like a tile of about a thousand points
+		const double points = tile.expected_points == ChildTile::UnknownPoints ? 1000.0 : static_cast<double>(tile.expected_points);
+		const double density = std::min(std::log2(1.0 + points) / 20.0, 1.0);
+
+		// Both terms are in [0, 1] so they only reorder tiles of the same depth
+		return -tile.depth + 0.5 * density + 0.49 * closeness;
+	};
+}
+
+struct LowerPriority
+{
+	bool operator()(const BoundsDepth& a, const BoundsDepth& b) const
+	{
+		return a.priority < b.priority || (a.priority == b.priority && a.sequence > b.sequence);
+	}
+};
+
+// A tile between the fetch and the convert stage of download_to
+struct FetchedTile
+{
+	BoundsDepth m;
+	pdal::Options opts;
+	std::vector<char> response;
+	// When the response was queued for the converters
+	TileTrace::Clock::time_point fetched_at;
+};
+
 void
 GreyhoundDownloader::download_to(ccPointCloud *cloud, const DownloadMethod method)
 {
-	std::queue<BoundsDepth> qin;
+	if (!cloud) {
+		return;
+	}
+
+	using TileQueue = std::priority_queue<BoundsDepth, std::vector<BoundsDepth>, LowerPriority>;
+	TileQueue qin;
+	uint64_t sequence = 0;
+	const auto enqueue = [&qin, &sequence, this](BoundsDepth m) {
+		m.priority = m_priority(m);
+		m.sequence = sequence++;
+		qin.push(std::move(m));
+	};
 	std::queue<BoundsDepth> qout;
 
 	std::mutex mu_qout;
+	std::condition_variable tile_done;
 
 	using mutex_locker = std::lock_guard<std::mutex>;
 
+	const CoordinatorTimer timer;
+	m_stats = DownloadStats();
+	m_stats.compressed = m_read.compressed();
+	m_tiles.clear();
+	std::vector<int> color_shifts;
 
-	QThreadPool pool;
-	pool.setMaxThreadCount(8);
+	// Points of the first depths, downloaded before
+	const size_t initial_points = cloud->size();
+	CloudSlices slices(cloud);
+	const size_t point_bytes = bytes_per_point(*cloud);
+	const size_t max_points = std::min(
+		m_budget.max_points ? m_budget.max_points : std::numeric_limits<size_t>::max(),
+		m_budget.max_bytes ? m_budget.max_bytes / point_bytes : std::numeric_limits<size_t>::max()
+	);
 
+	m_target_tile_points = 0;
+	try {
+		const size_t point_size = m_read.point_size();
+		m_target_tile_points = point_size ? m_target_tile_bytes / point_size : 0;
+	}
+	catch (const std::exception& e) {
+		ccLog::Print(QString("[qGreyhound] tiles keep their size: %1").arg(e.what()));
+	}
+
+	if (!m_hierarchy || m_hierarchy->split() != split_of(method)) {
+		m_hierarchy.reset(new HierarchyIndex(m_opts.getValueOrThrow<std::string>("url"), m_bounds, static_cast<int>(m_current_depth), split_of(method)));
+	}
+
+	// Size the cloud for the points the server says are coming in the
+	// first chunk of the hierarchy, so that most tiles are converted in place.
+	// The stop criteria cut the download short, the cloud must not be sized past them.
+	try {
+		const int first_depth = static_cast<int>(m_current_depth);
+		uint64_t expected = 0;
+		if (m_stop.max_depth && m_stop.max_depth < first_depth + HierarchyIndex::ChunkDepths) {
+			for (int depth = first_depth; depth <= m_stop.max_depth && expected != HierarchyIndex::UnknownPoints; ++depth) {
+				const uint64_t points = m_hierarchy->points(m_bounds, depth);
+				expected = points == HierarchyIndex::UnknownPoints ? points : expected + points;
+			}
+		}
+		else {
+			expected = m_hierarchy->points_under(m_bounds, first_depth);
+		}
+		if (expected != HierarchyIndex::UnknownPoints) {
+			size_t limit = max_points;
+			if (m_stop.max_points) {
+				limit = std::min(limit, std::max<size_t>(m_stop.max_points, cloud->size()));
+			}
+			slices.grow(static_cast<size_t>(std::min<uint64_t>(cloud->size() + expected, limit)));
+		}
+	}
+	catch (const std::exception& e) {
+		ccLog::Print(QString("[qGreyhound] hierarchy: %1").arg(e.what()));
+	}
+
+	ConcurrencyController concurrency(m_converter_threads);
+	m_stats.converter_threads = concurrency.convert().limit();
+	BoundedQueue<FetchedTile> fetched(concurrency.convert().limit());
+
+	const auto finish = [&qout, &mu_qout, &tile_done](const BoundsDepth& m) {
+		{
+			mutex_locker lk(mu_qout);
+			qout.push(m);
+		}
+		tile_done.notify_one();
+	};
 
-	const auto f = [&qout, &mu_qout, this](BoundsDepth m) {
+	// First stage: only waits on the disk cache or the network
+	const auto fetch = [&fetched, &concurrency, &finish, method, this](BoundsDepth m) {
 		pdal::Options opts(m_opts);
 		opts.add("depth_begin", m.depth);
 		opts.add("depth_end", m.depth + 1);
 		opts.add("bounds", m.b.toJson());
 		try {
-			m.cloud = new ccPointCloud("a");
-			download_and_convert_cloud(m.cloud, opts, m_converter);
+			const LimitGuard fetching(concurrency.fetch());
+			if (cancelled()) {
+				throw DownloadCancelled();
+			}
+			const TraceTile traced = m_trace ? trace_tile(m.b, m.depth) : TraceTile();
+			{
+				const TracePhase phase(m_trace.get(), "hierarchy", traced);
+				m.children = children_of(m.b, m.depth, method, method == DownloadMethod::Octree || m_stop.max_points || m_target_tile_points);
+			}
+
+			if (m_cache) {
+				TracePhase phase(m_trace.get(), "cache_load", traced);
+				m.cloud = new ccPointCloud("a");
+				if (m_cache->load(opts, m_converter, m.cloud, &m.color_shift)) {
+					m.points = m.cloud->size();
+					phase.tile.points = m.points;
+					finish(m);
+					return;
+				}
+				delete m.cloud;
+				m.cloud = nullptr;
+			}
+
+			FetchedTile tile;
+			double first_byte_seconds = 0;
+			try {
+				TracePhase phase(m_trace.get(), "http", traced);
+				tile.response = m_read.fetch(m.b, m.depth, m.depth + 1, m_cancel.get(), &first_byte_seconds);
+				phase.tile.bytes = tile.response.size();
+			}
+			catch (const DownloadCancelled&) {
+				throw;
+			}
+			catch (...) {
+				concurrency.fetch_failed();
+				throw;
+			}
+			concurrency.fetch_succeeded(first_byte_seconds);
+			m.bytes = tile.response.size();
+			tile.m = m;
+			tile.opts = opts;
+			tile.fetched_at = TileTrace::Clock::now();
+			if (!fetched.push(std::move(tile))) {
+				// The converters are gone, the tile will never be converted
+				m.cancelled = true;
+				finish(m);
+			}
+		}
+		catch (const DownloadCancelled&) {
+			delete m.cloud;
+			m.cloud = nullptr;
+			m.cancelled = true;
+			finish(m);
 		}
 		catch (const std::exception& e) {
 			ccLog::Print(QString("[qGreyhound] %1").arg(e.what()));
+			delete m.cloud;
 			m.cloud = nullptr;
+			m.failed = true;
+			finish(m);
 		}
+	};
 
-		mutex_locker lk(mu_qout);
-		qout.push(m);
+	// Second stage: decodes and converts what was fetched, never waits on the network
+	const auto convert = [&fetched, &slices, &finish, cloud, this]() {
+		PDALConverter converter(m_converter);
+		// The converters already convert a tile each
+		converter.set_parallel(false);
+		FetchedTile tile;
+		while (fetched.pop(tile)) {
+			BoundsDepth m = tile.m;
+			TraceTile traced;
+			if (m_trace) {
+				traced = trace_tile(m.b, m.depth);
+				traced.bytes = m.bytes;
+				m_trace->record("queued", tile.fetched_at, TileTrace::Clock::now(), traced);
+			}
+			if (cancelled()) {
+				m.cancelled = true;
+				finish(m);
+				continue;
+			}
+			try {
+				pdal::PointTable table;
+				pdal::PointViewPtr view;
+				{
+					TracePhase phase(m_trace.get(), "decode", traced);
+					const auto decode_start = std::chrono::steady_clock::now();
+					view = m_read.decode(tile.response, table);
+					m.decode_seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - decode_start).count();
+					phase.tile.points = view->size();
+				}
+				std::vector<char>().swap(tile.response);
+				traced.points = view->size();
+
+				unsigned first_index = 0;
+				if (PDALConverter::can_convert_into(table.layout(), cloud) && slices.acquire(view->size(), first_index)) {
+					try {
+						{
+							const TracePhase phase(m_trace.get(), "convert", traced);
+							m.color_shift = converter.convert_into(view, table.layout(), cloud, first_index);
+						}
+						if (m_cache) {
+							const TracePhase phase(m_trace.get(), "cache_store", traced);
+							m_cache->store_range(tile.opts, converter, m.color_shift, *cloud, first_index, static_cast<unsigned>(view->size()));
+						}
+					}
+					catch (...) {
+						// Nothing of the tile may stay in the cloud
+						slices.release();
+						slices.discard(first_index, view->size());
+						throw;
+					}
+					slices.release();
+					m.points = view->size();
+					m.first_index = first_index;
+				}
+				else {
+					// No room left in the cloud, the coordinator will copy it in
+					m.cloud = new ccPointCloud("a");
+					const CloudMark before(*m.cloud);
+					{
+						const TracePhase phase(m_trace.get(), "convert", traced);
+						m.color_shift = converter.convert(view, table.layout(), m.cloud);
+					}
+					if (m_cache) {
+						const TracePhase phase(m_trace.get(), "cache_store", traced);
+						m_cache->store(tile.opts, converter, m.color_shift, *m.cloud, before);
+					}
+					m.points = m.cloud->size();
+				}
+			}
+			catch (const std::exception& e) {
+				ccLog::Print(QString("[qGreyhound] %1").arg(e.what()));
+				delete m.cloud;
+				m.cloud = nullptr;
+				m.points = 0;
+				m.failed = true;
+			}
+			finish(m);
+		}
+	};
+
+	// Follows the fetch limit as it changes, tiles beyond it wait in the pool's queue
+	QThreadPool fetch_pool;
+	fetch_pool.setMaxThreadCount(static_cast<int>(concurrency.fetch().limit()));
+	QThreadPool convert_pool;
+	convert_pool.setMaxThreadCount(static_cast<int>(concurrency.convert().limit()));
+	for (size_t i = 0; i < concurrency.convert().limit(); ++i) {
+		QtConcurrent::run(&convert_pool, convert);
+	}
+	// Lets the converters return before convert_pool waits for them, whatever happens
+	const QueueCloser<FetchedTile> close_fetched(fetched);
+
+	size_t in_flight = 0;
+
+	// Whether adding points (plus the expected content of the tiles in flight) goes over budget
+	const auto over_budget = [&](const size_t points, const size_t extra_tiles) {
+		const size_t average_tile = m_stats.tiles ? m_stats.points / m_stats.tiles : 0;
+		const size_t expected = std::max(slices.capacity(), slices.used() + points + (in_flight + extra_tiles) * average_tile);
+		if (!m_budget.exceeded(expected, expected * point_bytes)) {
+			return false;
+		}
+		m_stats.budget_limit = m_budget.max_points && expected > m_budget.max_points
+			? QString("%1 points").arg(m_budget.max_points)
+			: QString("%1 MiB").arg(m_budget.max_bytes >> 20);
+		return true;
 	};
 
-	qin.emplace(m_bounds, static_cast<int>(m_current_depth));
-	while (!qin.empty() || !qout.empty() || pool.activeThreadCount() != 0)
+	// Points announced by the hierarchy for the tiles requested but not back yet
+	uint64_t pending_points = 0;
+	const int max_depth = m_stop.max_depth ? std::min(m_stop.max_depth, static_cast<int>(CCLib::DgmOctree::MAX_OCTREE_LEVEL)) : static_cast<int>(CCLib::DgmOctree::MAX_OCTREE_LEVEL);
+
+	// Whether a child of m is worth requesting
+	const auto refine = [&](const BoundsDepth& m, const ChildTile& child) {
+		if (m.depth + 1 > max_depth) {
+			return false;
+		}
+		if (m_stop.spacing > 0) {
+			const double points = m.points_above + m.points;
+			if (points > 0 && std::sqrt(area(m.b) / points) <= m_stop.spacing) {
+				return false;
+			}
+		}
+		if (m_stop.max_points) {
+			const uint64_t total = initial_points + m_stats.points + pending_points;
+			if (child.points == ChildTile::UnknownPoints ? total >= m_stop.max_points : total + child.points > m_stop.max_points) {
+				return false;
+			}
+		}
+		return true;
+	};
+
+	// The first depths are already in the cloud, the start depth itself may be dense enough to split
+	std::vector<ChildTile> roots{ { m_bounds, ChildTile::UnknownPoints } };
+	if (m_target_tile_points) {
+		try {
+			roots.front().points = m_hierarchy->points(m_bounds, static_cast<int>(m_current_depth));
+			roots = sized_tiles(std::move(roots), m_bounds, static_cast<int>(m_current_depth), method);
+		}
+		catch (const std::exception& e) {
+			ccLog::Print(QString("[qGreyhound] hierarchy: %1").arg(e.what()));
+			roots = { { m_bounds, ChildTile::UnknownPoints } };
+		}
+	}
+	for (const auto& tile : roots) {
+		if (tile.points == 0) {
+			continue;
+		}
+		BoundsDepth root(tile.b, static_cast<int>(m_current_depth));
+		root.expected_points = tile.points;
+		root.points_above = static_cast<double>(initial_points) * share_of(tile.b, m_bounds, method);
+		if (root.expected_points != ChildTile::UnknownPoints) {
+			pending_points += root.expected_points;
+		}
+		enqueue(root);
+	}
+	while (!qin.empty() || in_flight != 0)
 	{
-		if (!qin.empty())
+		// Only keep enough tiles in flight to feed both stages, the rest
+		// wait here where they can still be dropped by the budget
+		while (!qin.empty() && in_flight < concurrency.max_in_flight())
 		{
-			BoundsDepth m = qin.front();
+			if (cancelled()) {
+				m_stats.cancelled = true;
+				m_stats.skipped_tiles += qin.size();
+				qin = TileQueue();
+				break;
+			}
+			if (over_budget(0, 1)) {
+				// Stop refining, what is still queued will never be requested
+				m_stats.budget_reached = true;
+				m_stats.skipped_tiles += qin.size();
+				qin = TileQueue();
+				break;
+			}
+
+			BoundsDepth m = qin.top();
 			qin.pop();
-			auto w = new DlWorker(f);
+			auto w = new DlWorker(fetch);
 			w->setAutoDelete(true);
 			w->m = m;
-			pool.start(w);
+			fetch_pool.setMaxThreadCount(static_cast<int>(concurrency.fetch().limit()));
+			fetch_pool.start(w);
+			in_flight++;
+		}
+		if (in_flight == 0) {
+			// Everything left was dropped
+			break;
 		}
+
 		BoundsDepth m;
 		{
-			mutex_locker lk(mu_qout);
-			if (qout.empty()) {
-				continue;
-			}
+			// Sleep until a worker hands back a tile
+			std::unique_lock<std::mutex> lk(mu_qout);
+			tile_done.wait(lk, [&qout] { return !qout.empty(); });
 			m = qout.front();
 			qout.pop();
 		}
-		if (m.cloud && m.cloud->size() && cloud)
+		in_flight--;
+		m_stats.tiles++;
+		m_stats.bytes += m.bytes;
+		m_stats.decode_seconds += m.decode_seconds;
+		if (m.decode_seconds > 0) {
+			m_stats.decoded_bytes += m.points * m_read.point_size();
+		}
+		if (m.expected_points != ChildTile::UnknownPoints) {
+			pending_points -= m.expected_points;
+		}
+
+		if (m.failed) {
+			m_stats.failed_tiles++;
+		}
+		else if (m.cancelled) {
+			m_stats.skipped_tiles++;
+		}
+		else if (m.cloud && m.points)
 		{
-			if (cloud->hasDisplayedScalarField() || cloud->colorsShown()) {
-				m.cloud->showSF(false);
-				m.cloud->showColors(false);
+			// Not converted in place: a cached tile or no room was left
+			if (over_budget(m.points, 0)) {
+				m_stats.budget_reached = true;
+				m_stats.skipped_tiles++;
+				m.points = 0;
+			}
+			else if (slices.grow(std::max(slices.used() + m.points, std::min(2 * slices.capacity(), max_points)))
+				&& slices.add_fields_of(*m.cloud)
+				&& slices.acquire(m.points, m.first_index))
+			{
+				{
+					TracePhase phase(m_trace.get(), "append", m_trace ? trace_tile(m.b, m.depth) : TraceTile());
+					phase.tile.points = m.points;
+					copy_into(*m.cloud, cloud, m.first_index);
+				}
+				slices.release();
+			}
+			else {
+				ccLog::Error("Failed to allocate memory for the points.");
+				m_stats.failed_tiles++;
+				m.points = 0;
 			}
+		}
+		delete m.cloud;
+		m.cloud = nullptr;
 
-			cloud->append(m.cloud, cloud->size());
-			//Ideally we would like to refresh soon after appending
-			//but we can't because the main thread also refreshes the 
-			//display from time to time/ on some user action causing crashes?
-			//cloud->prepareDisplayForRefresh();
-			//cloud->refreshDisplay();
+		if (m.points)
+		{
+			if (m_stats.first_points_seconds < 0) {
+				m_stats.first_points_seconds = timer.elapsed();
+			}
+			m_stats.points += m.points;
+			m_tiles.push_back({ m.b, m.depth, m.depth + 1, m.first_index, static_cast<unsigned>(m.points) });
+			color_shifts.push_back(m.color_shift);
+			// The range is complete and only resized from this thread,
+			// the display gets a copy instead of touching the cloud
+			if (m_on_tile) {
+				m_on_tile(*cloud, m.first_index, static_cast<unsigned>(m.points));
+			}
 
-			if (m.depth + 1 <= CCLib::DgmOctree::MAX_OCTREE_LEVEL)
+			if (!m_stats.budget_reached && !cancelled())
 			{
-				switch (method)
-				{
-				case GreyhoundDownloader::DownloadMethod::DepthByDepth:
-					qin.emplace(m.b, m.depth + 1);
-					break;
-				case GreyhoundDownloader::DownloadMethod::Quadtree:
-					qin.emplace(m.b.getSe(), m.depth + 1);
-					qin.emplace(m.b.getSw(), m.depth + 1);
-					qin.emplace(m.b.getNe(), m.depth + 1);
-					qin.emplace(m.b.getNw(), m.depth + 1);
-					break;
-				case GreyhoundDownloader::DownloadMethod::Octree:
-					break;
-				default:
-					break;
+				for (const auto& child : m.children) {
+					if (!refine(m, child)) {
+						m_stats.stopped_tiles++;
+						continue;
+					}
+					BoundsDepth c(child.b, m.depth + 1);
+					c.expected_points = child.points;
+					// Points above spread evenly over the children
+					c.points_above = (m.points_above + m.points) * share_of(child.b, m.b, method);
+					if (c.expected_points != ChildTile::UnknownPoints) {
+						pending_points += c.expected_points;
+					}
+					enqueue(c);
 				}
 			}
 		}
 	}
+
+	slices.shrink_to_used();
+	for (auto& tile : m_tiles) {
+		tile.first_index = slices.compacted_index(tile.first_index);
+	}
+	// Tiles converted before an Auto color depth settled on 16 bits were written as 8 bit colors
+	for (size_t i = 0; i < m_tiles.size(); ++i) {
+		PDALConverter::recolor(cloud, m_tiles[i].first_index, m_tiles[i].count, color_shifts[i], m_converter.effective_color_shift());
+	}
+	for (unsigned i = 0; i < cloud->getNumberOfScalarFields(); ++i) {
+		cloud->getScalarField(static_cast<int>(i))->computeMinAndMax();
+	}
+
+	m_stats.cancelled = cancelled();
+	m_stats.fetch_limit_highest = concurrency.fetch().highest();
+	m_stats.fetch_backoffs = concurrency.backoffs();
+	timer.stop(m_stats);
+	ccLog::Print(m_stats.summary());
+
+	QJsonObject report = m_stats.to_json();
+	report["method"] = method_name(method);
+	report["start_depth"] = static_cast<int>(m_current_depth);
+	report["bounds"] = QJsonArray{ m_bounds.min().x, m_bounds.min().y, m_bounds.min().z, m_bounds.max().x, m_bounds.max().y, m_bounds.max().z };
+	report["target_tile_bytes"] = static_cast<double>(m_target_tile_bytes);
+	publish_report(report);
+}
+
+void GreyhoundDownloader::set_memory_budget(const MemoryBudget budget)
+{
+	m_budget = budget;
+}
+
+void GreyhoundDownloader::set_stop_criteria(const StopCriteria criteria)
+{
+	m_stop = criteria;
+}
+
+void GreyhoundDownloader::set_converter_threads(const size_t threads)
+{
+	m_converter_threads = threads;
+}
+
+void GreyhoundDownloader::set_trace(std::shared_ptr<TileTrace> trace)
+{
+	m_trace = std::move(trace);
+}
+
+void GreyhoundDownloader::set_target_tile_bytes(const size_t bytes)
+{
+	m_target_tile_bytes = bytes;
+}
+
+void GreyhoundDownloader::set_compressed(const bool compressed)
+{
+	m_read.set_compressed(compressed);
+}
+
+void GreyhoundDownloader::set_priority(TilePriority priority)
+{
+	m_priority = std::move(priority);
+}
+
+void GreyhoundDownloader::set_tile_callback(TileCallback callback)
+{
+	m_on_tile = std::move(callback);
+}
+
+void GreyhoundDownloader::set_cancel_token(std::shared_ptr<const CancelToken> token)
+{
+	m_cancel = std::move(token);
+}
+
+bool GreyhoundDownloader::cancelled() const
+{
+	return m_cancel && m_cancel->cancelled();
+}
+
+void GreyhoundDownloader::set_cache(std::shared_ptr<TileCache> cache)
+{
+	m_cache = std::move(cache);
+}
+
+const DownloadStats& GreyhoundDownloader::stats() const
+{
+	return m_stats;
+}
+
+const std::vector<TileRange>& GreyhoundDownloader::tiles() const
+{
+	return m_tiles;
 }
\ No newline at end of file
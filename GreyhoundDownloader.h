@@ -1,25 +1,80 @@
 #pragma once
 
+#include <functional>
+#include <limits>
+#include <memory>
+
 #include <ccPointCloud.h>
 
 #include <GreyhoundCommon.hpp>
 
+#include "CancelToken.h"
+#include "ccGreyhoundCloud.h"
 #include "PDALConverter.h"
+#include "DownloadStats.h"
+#include "HierarchyIndex.h"
+#include "GreyhoundRead.h"
+#include "TileCache.h"
+#include "TileTrace.h"
+
+// The dims option of opts, as a json array
+Json::Value dimension_names(const pdal::Options& opts);
+// Converts the points of b from depth_begin up to depth_end into cloud, through read,
+// or loads them from cache, whose key opts is. The request is aborted, throwing
+// DownloadCancelled, once cancel is set. Returns the shift the colors of the points
+// added were written with, for PDALConverter::recolor once an Auto color depth settles.
+int download_and_convert_tile(ccPointCloud *cloud, const GreyhoundRead& read, const pdal::Options& opts, const pdal::greyhound::Bounds& b,
+	int depth_begin, int depth_end, PDALConverter converter, TileCache *cache, const CancelToken *cancel = nullptr, TileTrace *trace = nullptr);
+// The same on a thread of the global pool, running an event loop meanwhile
+int download_and_convert_tile_threaded(ccPointCloud *cloud, const GreyhoundRead& read, const pdal::Options& opts, const pdal::greyhound::Bounds& b,
+	int depth_begin, int depth_end, PDALConverter converter, TileCache *cache = nullptr, TileTrace *trace = nullptr);
+// Re-issues the tiles the cloud was built from asking only for dims
+// and writes the new columns where each tile's points are
+void download_dimensions(ccGreyhoundCloud *cloud, const std::string& url, const std::vector<GreyhoundDimension>& schema, const Json::Value& dims);
+void download_dimensions_threaded(ccGreyhoundCloud *cloud, const std::string& url, const std::vector<GreyhoundDimension>& schema, const Json::Value& dims);
 
-void download_and_convert_cloud(ccPointCloud *cloud, const pdal::Options& opts, PDALConverter converter = PDALConverter());
-void download_and_convert_cloud_threaded(ccPointCloud *cloud, const pdal::Options& opts, PDALConverter converter = PDALConverter());
+// A tile refining another one, with the number of points the hierarchy gives it
+struct ChildTile
+{
+	static constexpr uint64_t UnknownPoints = HierarchyIndex::UnknownPoints;
+
+	pdal::greyhound::Bounds b;
+	uint64_t points;
+};
 
 struct BoundsDepth
 {
 	BoundsDepth()
 		: depth(0)
 		, cloud(nullptr)
+		, points(0)
+		, first_index(0)
+		, color_shift(0)
+		, failed(false)
+		, cancelled(false)
+		, expected_points(ChildTile::UnknownPoints)
+		, points_above(0)
+		, priority(0)
+		, sequence(0)
+		, bytes(0)
+		, decode_seconds(0)
 	{}
 
 	BoundsDepth(const pdal::greyhound::Bounds &b, const int depth)
 		: b(b)
 		, depth(depth)
 		, cloud(nullptr)
+		, points(0)
+		, first_index(0)
+		, color_shift(0)
+		, failed(false)
+		, cancelled(false)
+		, expected_points(ChildTile::UnknownPoints)
+		, points_above(0)
+		, priority(0)
+		, sequence(0)
+		, bytes(0)
+		, decode_seconds(0)
 	{}
 	BoundsDepth(const pdal::greyhound::Bounds &b, const int depth, ccPointCloud* c)
 		: BoundsDepth(b, depth)
@@ -28,9 +83,73 @@ struct BoundsDepth
 	}
 	pdal::greyhound::Bounds b;
 	int depth;
+	// Set when the tile could not be converted in place in the target cloud
 	ccPointCloud *cloud;
+	size_t points;
+	// Where the points are in the target cloud once placed
+	unsigned first_index;
+	// What the colors were written with, see PDALConverter::recolor
+	int color_shift;
+	bool failed;
+	bool cancelled;
+	// What the hierarchy announced for this tile
+	uint64_t expected_points;
+	// Estimate of the points of b already downloaded at the depths above
+	double points_above;
+	// Order in which the tiles are requested, highest first then oldest first
+	double priority;
+	uint64_t sequence;
+	// Non empty children at depth + 1, filled by the worker
+	std::vector<ChildTile> children;
+	// Size of the response as received, 0 when it came from the cache
+	size_t bytes;
+	double decode_seconds;
 };
 
+// Limits on the memory a download may use, 0 means no limit
+struct MemoryBudget
+{
+	MemoryBudget()
+		: max_points(0)
+		, max_bytes(0)
+	{}
+
+	bool exceeded(const size_t points, const size_t bytes) const
+	{
+		return (max_points && points > max_points) || (max_bytes && bytes > max_bytes);
+	}
+
+	size_t max_points;
+	size_t max_bytes;
+};
+
+// Higher means requested sooner
+using TilePriority = std::function<double(const BoundsDepth& tile)>;
+
+// Coarser tiles first, then among a depth the ones with more points
+// and closer to focus. scale is the distance at which closeness stops mattering.
+TilePriority default_tile_priority(CCVector3d focus, double scale);
+
+// When to stop refining, 0 means no limit
+struct StopCriteria
+{
+	StopCriteria()
+		: max_points(0)
+		, spacing(0)
+		, max_depth(0)
+	{}
+
+	// Total number of points of the cloud
+	size_t max_points;
+	// An area is not refined once its points are this close, in metres
+	double spacing;
+	// Deepest depth requested
+	int max_depth;
+};
+
+// Memory used by one point of the cloud with its colors and scalar fields
+size_t bytes_per_point(const ccPointCloud& cloud);
+
 class GreyhoundDownloader
 {
 public:
@@ -41,15 +160,68 @@ public:
 		Octree
 	};
 
+	// Called from the downloading thread each time a tile's points are in the cloud
+	using TileCallback = std::function<void(const ccPointCloud& cloud, unsigned first_index, unsigned count)>;
+
+	// Payload a request aims at: sibling tiles holding less together are
+	// asked as one, tiles holding more are split in up to MaxTileSplits steps
+	static constexpr size_t TargetTileBytes = 4 << 20;
+	static constexpr int MaxTileSplits = 3;
+
 public:
-	GreyhoundDownloader(const pdal::Options& opts, uint32_t start_depth, pdal::greyhound::Bounds bounds, PDALConverter converter);
+	// schema is the resource's, from its /info
+	GreyhoundDownloader(const pdal::Options& opts, const std::vector<GreyhoundDimension>& schema, uint32_t start_depth, pdal::greyhound::Bounds bounds, PDALConverter converter);
 	void download_to(ccPointCloud* cloud, DownloadMethod);
+	void set_cache(std::shared_ptr<TileCache> cache);
+	void set_memory_budget(MemoryBudget budget);
+	void set_stop_criteria(StopCriteria criteria);
+	// 0 asks every tile as the method splits it
+	void set_target_tile_bytes(size_t bytes);
+	// Defaults to compressed responses when PDAL can decompress them
+	void set_compressed(bool compressed);
+	// 0, the default, converts on one thread per core
+	void set_converter_threads(size_t threads);
+	// Records the phases of every tile of download_to
+	void set_trace(std::shared_ptr<TileTrace> trace);
+	// Defaults to default_tile_priority focused on the center of the bounds
+	void set_priority(TilePriority priority);
+	void set_tile_callback(TileCallback callback);
+	// Once the token is set, no new tile is requested and the running requests are aborted
+	void set_cancel_token(std::shared_ptr<const CancelToken> token);
+	// Also published as a json report at the end of download_to, see publish_report
+	const DownloadStats& stats() const;
+	// Where each tile of the last download_to went in the cloud
+	const std::vector<TileRange>& tiles() const;
 
 
+private:
+	bool cancelled() const;
+	// Tiles refining b at depth + 1 for the method, the ones the hierarchy says are empty are left out.
+	// Counts are only asked to the hierarchy when with_counts is set.
+	std::vector<ChildTile> children_of(const pdal::greyhound::Bounds& b, int depth, DownloadMethod method, bool with_counts) const;
+	// Merges the tiles of parent at depth into one if they are sparse, splits the dense ones
+	std::vector<ChildTile> sized_tiles(std::vector<ChildTile> tiles, const pdal::greyhound::Bounds& parent, int depth, DownloadMethod method) const;
+	void split_dense(const ChildTile& tile, int depth, DownloadMethod method, int splits, std::vector<ChildTile>& out) const;
 
 private:
 	pdal::Options m_opts;
 	uint32_t m_current_depth;
 	pdal::greyhound::Bounds m_bounds;
 	PDALConverter m_converter;
+	// Built by download_to for its method, kept while the method stays the same
+	std::unique_ptr<HierarchyIndex> m_hierarchy;
+	GreyhoundRead m_read;
+	std::shared_ptr<TileCache> m_cache;
+	MemoryBudget m_budget;
+	StopCriteria m_stop;
+	size_t m_target_tile_bytes;
+	// m_target_tile_bytes in points of the requested schema, set by download_to
+	uint64_t m_target_tile_points;
+	size_t m_converter_threads;
+	TilePriority m_priority;
+	TileCallback m_on_tile;
+	std::shared_ptr<const CancelToken> m_cancel;
+	std::shared_ptr<TileTrace> m_trace;
+	DownloadStats m_stats;
+	std::vector<TileRange> m_tiles;
 };
\ No newline at end of file
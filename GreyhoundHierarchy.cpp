@@ -0,0 +1,56 @@
+#include <QUrl>
+
+#include <arbiter/arbiter.hpp>
+
+#include "GreyhoundHierarchy.h"
+
+using Bounds = pdal::greyhound::Bounds;
+
+Bounds
+octant_bounds(const Bounds& b, const Octant octant)
+{
+	const int o = static_cast<int>(octant);
+	const bool east = o & 1;
+	const bool north = o & 2;
+	const bool up = o & 4;
+
+	const double midx = (b.min().x + b.max().x) / 2.0;
+	const double midy = (b.min().y + b.max().y) / 2.0;
+	const double midz = (b.min().z + b.max().z) / 2.0;
+
+	return {
+		east ? midx : b.min().x,
+		north ? midy : b.min().y,
+		up ? midz : b.min().z,
+		east ? b.max().x : midx,
+		north ? b.max().y : midy,
+		up ? b.max().z : midz
+	};
+}
+
+GreyhoundHierarchy::GreyhoundHierarchy(std::string resource_url)
+	: m_url(std::move(resource_url))
+{
+}
+
+Json::Value
+GreyhoundHierarchy::fetch(const Bounds& b, const int depth_begin, const int depth_end) const
+{
+	Json::FastWriter writer;
+	std::string bounds = writer.write(b.toJson());
+	bounds.erase(bounds.find_last_not_of('\n') + 1);
+
+	const std::string url = m_url + "/hierarchy?bounds=" + QUrl::toPercentEncoding(QString::fromStdString(bounds)).toStdString()
+		+ "&depthBegin=" + std::to_string(depth_begin)
+		+ "&depthEnd=" + std::to_string(depth_end);
+
+	arbiter::Arbiter arbiter;
+	const std::string response = arbiter.get(url);
+
+	Json::Value node;
+	Json::Reader reader;
+	if (!reader.parse(response, node, false)) {
+		throw std::runtime_error("Received hierarchy is not a proper json object");
+	}
+	return node;
+}
\ No newline at end of file
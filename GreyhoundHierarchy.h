@@ -0,0 +1,32 @@
+#pragma once
+
+#include <array>
+#include <string>
+
+#include <GreyhoundCommon.hpp>
+
+// The 8 children of a greyhound octree node,
+// in the order of the keys of the /hierarchy response
+enum class Octant
+{
+	Swd, Sed, Nwd, Ned, Swu, Seu, Nwu, Neu
+};
+
+constexpr std::array<const char*, 8> OctantKeys{ {"swd", "sed", "nwd", "ned", "swu", "seu", "nwu", "neu"} };
+
+pdal::greyhound::Bounds octant_bounds(const pdal::greyhound::Bounds& b, Octant octant);
+
+// A resource's /hierarchy endpoint
+class GreyhoundHierarchy
+{
+public:
+	explicit GreyhoundHierarchy(std::string resource_url);
+
+	// Point counts of b from depth_begin up to, but excluding, depth_end.
+	// The root is b at depth_begin, each node holds its count in "n"
+	// and its non empty children under OctantKeys.
+	Json::Value fetch(const pdal::greyhound::Bounds& b, int depth_begin, int depth_end) const;
+
+private:
+	std::string m_url;
+};
\ No newline at end of file
@@ -0,0 +1,241 @@
+#include <QElapsedTimer>
+#include <QEventLoop>
+#include <QNetworkAccessManager>
+#include <QNetworkReply>
+#include <QTimer>
+#include <QUrl>
+
+#include <algorithm>
+#include <cstring>
+#include <memory>
+
+#include <pdal/pdal_features.hpp>
+#ifdef PDAL_HAVE_LAZPERF
+#include <pdal/compression/LazPerfCompression.hpp>
+#endif
+
+#include "GreyhoundRead.h"
+
+using Type = pdal::Dimension::Type;
+
+static Type
+dimension_type(const std::string& type, const unsigned size)
+{
+	if (type == "floating") {
+		switch (size)
+		{
+		case 4: return Type::Float;
+		case 8: return Type::Double;
+		}
+	}
+	else if (type == "signed") {
+		switch (size)
+		{
+		case 1: return Type::Signed8;
+		case 2: return Type::Signed16;
+		case 4: return Type::Signed32;
+		case 8: return Type::Signed64;
+		}
+	}
+	else if (type == "unsigned") {
+		switch (size)
+		{
+		case 1: return Type::Unsigned8;
+		case 2: return Type::Unsigned16;
+		case 4: return Type::Unsigned32;
+		case 8: return Type::Unsigned64;
+		}
+	}
+	throw std::runtime_error("Unsupported dimension type " + type + std::to_string(size * 8));
+}
+
+static const char*
+greyhound_type(const Type type)
+{
+	switch (pdal::Dimension::base(type))
+	{
+	case pdal::Dimension::BaseType::Signed: return "signed";
+	case pdal::Dimension::BaseType::Unsigned: return "unsigned";
+	default: return "floating";
+	}
+}
+
+static std::string
+percent_encoded(const Json::Value& value)
+{
+	Json::FastWriter writer;
+	std::string json = writer.write(value);
+	json.erase(json.find_last_not_of('\n') + 1);
+	return QUrl::toPercentEncoding(QString::fromStdString(json)).toStdString();
+}
+
+GreyhoundRead::GreyhoundRead(std::string resource_url, std::vector<GreyhoundDimension> schema, const Json::Value& dims, const bool with_xyz)
+	: m_url(std::move(resource_url))
+	, m_resource_schema(std::move(schema))
+	, m_dims(dims)
+	, m_with_xyz(with_xyz)
+	, m_compressed(compression_available())
+{
+}
+
+bool
+GreyhoundRead::compression_available()
+{
+#ifdef PDAL_HAVE_LAZPERF
+	return true;
+#else
+	return false;
+#endif
+}
+
+void
+GreyhoundRead::set_compressed(const bool compressed)
+{
+	m_compressed = compressed && compression_available();
+}
+
+const ReadSchema&
+GreyhoundRead::schema() const
+{
+	std::call_once(m_schema_built, [this]() {
+		std::vector<std::string> wanted;
+		for (const auto& name : m_dims) {
+			wanted.push_back(name.asString());
+		}
+		for (const char *name : { "X", "Y", "Z" }) {
+			if (m_with_xyz && std::find(wanted.begin(), wanted.end(), name) == wanted.end()) {
+				wanted.push_back(name);
+			}
+		}
+
+		ReadSchema schema;
+		Json::Value request(Json::arrayValue);
+		for (const auto& dim : m_resource_schema) {
+			const std::string name = dim.name.toStdString();
+			if (std::find(wanted.begin(), wanted.end(), name) == wanted.end()) {
+				continue;
+			}
+			// Positions are asked unscaled, as doubles
+			const bool xyz = name == "X" || name == "Y" || name == "Z";
+			const Type type = xyz ? Type::Double : dimension_type(dim.type.toStdString(), static_cast<unsigned>(dim.size));
+			schema.push_back({ name, type });
+
+			Json::Value entry;
+			entry["name"] = name;
+			entry["type"] = greyhound_type(type);
+			entry["size"] = static_cast<Json::UInt>(pdal::Dimension::size(type));
+			request.append(entry);
+		}
+		m_schema = std::move(schema);
+		m_schema_json = percent_encoded(request);
+	});
+	return m_schema;
+}
+
+std::vector<char>
+GreyhoundRead::fetch(const pdal::greyhound::Bounds& b, const int depth_begin, const int depth_end, const CancelToken *cancel, double *first_byte_seconds) const
+{
+	schema();
+	const std::string url = m_url + "/read?schema=" + m_schema_json
+		+ "&bounds=" + percent_encoded(b.toJson())
+		+ "&depthBegin=" + std::to_string(depth_begin)
+		+ "&depthEnd=" + std::to_string(depth_end)
+		+ "&compress=" + (m_compressed ? "true" : "false");
+
+	// One manager per fetch thread so that connections are reused
+	thread_local QNetworkAccessManager qnam;
+	QNetworkRequest request(QUrl::fromEncoded(QByteArray::fromStdString(url)));
+	QElapsedTimer elapsed;
+	elapsed.start();
+	std::unique_ptr<QNetworkReply> reply(qnam.get(request));
+
+	qint64 first_byte_ns = -1;
+	QObject::connect(reply.get(), &QNetworkReply::metaDataChanged, [&first_byte_ns, &elapsed]() {
+		if (first_byte_ns < 0) {
+			first_byte_ns = elapsed.nsecsElapsed();
+		}
+	});
+
+	QEventLoop loop;
+	QObject::connect(reply.get(), &QNetworkReply::finished, &loop, &QEventLoop::quit);
+	QTimer poll;
+	if (cancel) {
+		QObject::connect(&poll, &QTimer::timeout, [cancel, &reply]() {
+			if (cancel->cancelled()) {
+				reply->abort();
+			}
+		});
+		poll.start(CancelPollMs);
+	}
+	if (!reply->isFinished()) {
+		loop.exec();
+	}
+
+	if (cancel && cancel->cancelled()) {
+		throw DownloadCancelled();
+	}
+	if (reply->error() != QNetworkReply::NoError) {
+		throw std::runtime_error(reply->errorString().toStdString());
+	}
+	if (first_byte_seconds) {
+		*first_byte_seconds = (first_byte_ns < 0 ? elapsed.nsecsElapsed() : first_byte_ns) / 1e9;
+	}
+	const QByteArray response = reply->readAll();
+	return std::vector<char>(response.begin(), response.end());
+}
+
+pdal::PointViewPtr
+GreyhoundRead::decode(const std::vector<char>& response, pdal::PointTable& table) const
+{
+	pdal::DimTypeList dim_types;
+	for (const auto& dim : schema()) {
+		const auto id = table.layout()->registerOrAssignDim(dim.name, dim.type);
+		dim_types.emplace_back(id, dim.type);
+	}
+	table.finalize();
+	const size_t point_size = this->point_size();
+
+	// The response ends with the number of points it holds
+	uint32_t count = 0;
+	if (response.size() < sizeof(count)) {
+		throw std::runtime_error("Truncated read response");
+	}
+	std::memcpy(&count, response.data() + response.size() - sizeof(count), sizeof(count));
+
+	pdal::PointViewPtr view(new pdal::PointView(table));
+	if (m_compressed) {
+#ifdef PDAL_HAVE_LAZPERF
+		pdal::PointId id = 0;
+		const auto store = [&view, &dim_types, &id, point_size, count](char *buf, size_t bufsize) {
+			for (size_t pos = 0; pos + point_size <= bufsize && id < count; pos += point_size) {
+				view->setPackedPoint(dim_types, id++, buf + pos);
+			}
+		};
+		pdal::LazPerfDecompressor decompressor(store, dim_types, count);
+		decompressor.decompress(response.data(), response.size() - sizeof(count));
+		if (id != count) {
+			throw std::runtime_error("Compressed read response does not match the requested schema");
+		}
+#endif
+		return view;
+	}
+
+	if (response.size() != sizeof(count) + count * point_size) {
+		throw std::runtime_error("Read response does not match the requested schema");
+	}
+	const char *pos = response.data();
+	for (pdal::PointId i = 0; i < count; ++i, pos += point_size) {
+		view->setPackedPoint(dim_types, i, pos);
+	}
+	return view;
+}
+
+size_t
+GreyhoundRead::point_size() const
+{
+	size_t size = 0;
+	for (const auto& dim : schema()) {
+		size += pdal::Dimension::size(dim.type);
+	}
+	return size;
+}
@@ -0,0 +1,65 @@
+#pragma once
+
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <pdal/pdal.hpp>
+
+#include <GreyhoundCommon.hpp>
+
+#include "CancelToken.h"
+#include "ccGreyhoundResource.h"
+
+struct ReadDim
+{
+	std::string name;
+	pdal::Dimension::Type type;
+};
+
+// Dimensions in the order they are packed in a /read response
+using ReadSchema = std::vector<ReadDim>;
+
+// Raw /read queries of a resource, split in a fetch that only waits
+// on the network and a decode that only uses the cpu.
+// Responses are laz-perf compressed whenever PDAL was built with it,
+// decompressing is then part of decode.
+class GreyhoundRead
+{
+public:
+	// How often a running request checks its cancel token
+	static constexpr int CancelPollMs = 50;
+
+	// schema is the resource's, from its /info. dims is the json array
+	// of the dimension names to read, the positions are added unless with_xyz is false
+	GreyhoundRead(std::string resource_url, std::vector<GreyhoundDimension> schema, const Json::Value& dims, bool with_xyz = true);
+
+	// Packed points of b from depth_begin up to, but excluding, depth_end.
+	// The request is aborted, throwing DownloadCancelled, once cancel is set.
+	// first_byte_seconds receives the time until the response headers came in,
+	// which unlike the whole transfer does not grow with the size of the tile.
+	std::vector<char> fetch(const pdal::greyhound::Bounds& b, int depth_begin, int depth_end, const CancelToken *cancel = nullptr, double *first_byte_seconds = nullptr) const;
+	// Fills a view of table with the points of a fetched response
+	pdal::PointViewPtr decode(const std::vector<char>& response, pdal::PointTable& table) const;
+	// Bytes of one point in a response, once decompressed
+	size_t point_size() const;
+
+	// Whether PDAL can decompress laz-perf responses
+	static bool compression_available();
+	// Ignored when compression is not available, to be set before fetching
+	void set_compressed(bool compressed);
+	bool compressed() const { return m_compressed; }
+
+private:
+	// The dims asked for, built from the resource's schema the first time it is needed
+	const ReadSchema& schema() const;
+
+	std::string m_url;
+	std::vector<GreyhoundDimension> m_resource_schema;
+	Json::Value m_dims;
+	bool m_with_xyz;
+	bool m_compressed;
+	mutable std::once_flag m_schema_built;
+	mutable ReadSchema m_schema;
+	mutable std::string m_schema_json;
+};
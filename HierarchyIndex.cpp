@@ -0,0 +1,362 @@
+#include <algorithm>
+#include <cmath>
+
+#include "HierarchyIndex.h"
+
+using Bounds = pdal::greyhound::Bounds;
+
+constexpr uint64_t HierarchyIndex::UnknownPoints;
+constexpr int HierarchyIndex::ChunkDepths;
+constexpr int HierarchyIndex::MaxLevel;
+
+namespace {
+
+constexpr size_t InitialCapacity = 1024;
+// Cells a single points() call may add up
+constexpr uint64_t MaxQueryCells = 4096;
+
+// Spreads the 21 low bits of v three bits apart
+uint64_t
+spread_bits(uint64_t v)
+{
+	v &= 0x1fffff;
+	v = (v | v << 32) & 0x1f00000000ffffull;
+	v = (v | v << 16) & 0x1f0000ff0000ffull;
+	v = (v | v << 8) & 0x100f00f00f00f00full;
+	v = (v | v << 4) & 0x10c30c30c30c30c3ull;
+	v = (v | v << 2) & 0x1249249249249249ull;
+	return v;
+}
+
+size_t
+slot_of(const uint64_t id, const size_t capacity)
+{
+	uint64_t h = id * 0x9e3779b97f4a7c15ull;
+	h ^= h >> 29;
+	return static_cast<size_t>(h) & (capacity - 1);
+}
+
+// Cell of value when [min, max] is cut in cells parts
+uint32_t
+cell_of(const double value, const double min, const double max, const uint32_t cells)
+{
+	if (max <= min) {
+		return 0;
+	}
+	const double cell = std::floor((value - min) / (max - min) * cells);
+	return static_cast<uint32_t>(std::min(std::max(cell, 0.0), static_cast<double>(cells - 1)));
+}
+
+// Cells of one axis that [lo, hi] overlaps
+struct CellSpan
+{
+	uint32_t count() const { return last - first + 1; }
+
+	// Part of cell i inside [lo, hi]
+	double share(const uint32_t i) const
+	{
+		if (size <= 0) {
+			return 1.0;
+		}
+		const double cell_min = min + size * i;
+		const double overlap = std::min(hi, cell_min + size) - std::max(lo, cell_min);
+		return std::max(overlap, 0.0) / size;
+	}
+
+	uint32_t first;
+	uint32_t last;
+	double lo;
+	double hi;
+	double min;
+	double size;
+};
+
+CellSpan
+span_of(const double lo, const double hi, const double min, const double max, const uint32_t cells)
+{
+	const double size = (max - min) / cells;
+	if (size <= 0) {
+		return { 0, 0, lo, hi, min, 0 };
+	}
+	// Bounds on cell edges must not pull in the neighbour cell
+	constexpr double Tolerance = 1e-9;
+	const double first = std::floor((lo - min) / size + Tolerance);
+	const double last = std::ceil((hi - min) / size - Tolerance) - 1;
+	const double top = static_cast<double>(cells - 1);
+	return {
+		static_cast<uint32_t>(std::min(std::max(first, 0.0), top)),
+		static_cast<uint32_t>(std::min(std::max(last, first), top)),
+		lo, hi, min, size
+	};
+}
+
+}
+
+HierarchyIndex::HierarchyIndex(std::string resource_url, Bounds root, const int root_depth, const Split split)
+	: m_source(std::move(resource_url))
+	, m_root(std::move(root))
+	, m_root_depth(root_depth)
+	, m_split(split)
+	, m_entries(InitialCapacity, Entry{ 0, 0, 0, ChunkState::Unloaded })
+	, m_size(0)
+{
+}
+
+uint64_t
+HierarchyIndex::points(const Bounds& b, const int depth)
+{
+	const int level = depth - m_root_depth;
+	if (level < 0 || level > MaxLevel) {
+		return UnknownPoints;
+	}
+	const uint32_t cells = 1u << level;
+	const CellSpan xs = span_of(b.min().x, b.max().x, m_root.min().x, m_root.max().x, m_split == Split::Flat ? 1 : cells);
+	const CellSpan ys = span_of(b.min().y, b.max().y, m_root.min().y, m_root.max().y, m_split == Split::Flat ? 1 : cells);
+	const CellSpan zs = span_of(b.min().z, b.max().z, m_root.min().z, m_root.max().z, m_split == Split::Octree ? cells : 1);
+	if (uint64_t(xs.count()) * ys.count() * zs.count() > MaxQueryCells) {
+		return UnknownPoints;
+	}
+
+	std::unique_lock<std::mutex> lock(m_mutex);
+	double total = 0;
+	for (uint32_t x = xs.first; x <= xs.last; ++x) {
+		for (uint32_t y = ys.first; y <= ys.last; ++y) {
+			for (uint32_t z = zs.first; z <= zs.last; ++z) {
+				const double share = xs.share(x) * ys.share(y) * zs.share(z);
+				const Key key{ level, x, y, z };
+				if (share <= 0 || !ensure_loaded(key, lock)) {
+					continue;
+				}
+				const Entry *entry = find(node_id(key));
+				if (entry) {
+					total += share * static_cast<double>(entry->points);
+				}
+			}
+		}
+	}
+	return static_cast<uint64_t>(std::llround(total));
+}
+
+uint64_t
+HierarchyIndex::points_under(const Bounds& b, const int depth)
+{
+	Key key;
+	if (!key_of(b, depth, key)) {
+		return UnknownPoints;
+	}
+	std::unique_lock<std::mutex> lock(m_mutex);
+	if (!ensure_loaded(key, lock)) {
+		return 0;
+	}
+	// A chunk root's count comes from the chunk above, what is below it from its own
+	if (key.level % ChunkDepths == 0 && !ensure_chunk(key, lock)) {
+		return 0;
+	}
+	const Entry *entry = find(node_id(key));
+	return entry ? entry->below : 0;
+}
+
+bool
+HierarchyIndex::key_of(const Bounds& b, const int depth, Key& key) const
+{
+	const int level = depth - m_root_depth;
+	if (level < 0 || level > MaxLevel) {
+		return false;
+	}
+	const uint32_t cells = 1u << level;
+	key.level = level;
+	key.x = cell_of((b.min().x + b.max().x) / 2, m_root.min().x, m_root.max().x, cells);
+	key.y = cell_of((b.min().y + b.max().y) / 2, m_root.min().y, m_root.max().y, cells);
+	key.z = cell_of((b.min().z + b.max().z) / 2, m_root.min().z, m_root.max().z, cells);
+	key = fold(key);
+	return true;
+}
+
+HierarchyIndex::Key
+HierarchyIndex::fold(Key key) const
+{
+	switch (m_split)
+	{
+	case Split::Flat:
+		key.x = 0;
+		key.y = 0;
+		key.z = 0;
+		break;
+	case Split::Quadtree:
+		key.z = 0;
+		break;
+	default:
+		break;
+	}
+	return key;
+}
+
+HierarchyIndex::Key
+HierarchyIndex::ancestor(const Key& key, const int level)
+{
+	const int shift = key.level - level;
+	return { level, key.x >> shift, key.y >> shift, key.z >> shift };
+}
+
+uint64_t
+HierarchyIndex::node_id(const Key& key)
+{
+	const uint64_t morton = spread_bits(key.x) | spread_bits(key.y) << 1 | spread_bits(key.z) << 2;
+	return (uint64_t(1) << (3 * key.level)) | morton;
+}
+
+Bounds
+HierarchyIndex::bounds_of(const Key& key) const
+{
+	const double cells = static_cast<double>(1u << key.level);
+	const auto range = [cells](const double min, const double max, const uint32_t cell, double& lo, double& hi) {
+		const double size = (max - min) / cells;
+		lo = min + size * cell;
+		hi = min + size * (cell + 1);
+	};
+
+	double min[3] = { m_root.min().x, m_root.min().y, m_root.min().z };
+	double max[3] = { m_root.max().x, m_root.max().y, m_root.max().z };
+	if (m_split != Split::Flat) {
+		range(m_root.min().x, m_root.max().x, key.x, min[0], max[0]);
+		range(m_root.min().y, m_root.max().y, key.y, min[1], max[1]);
+	}
+	if (m_split == Split::Octree) {
+		range(m_root.min().z, m_root.max().z, key.z, min[2], max[2]);
+	}
+	return { min[0], min[1], min[2], max[0], max[1], max[2] };
+}
+
+bool
+HierarchyIndex::ensure_loaded(const Key& key, std::unique_lock<std::mutex>& lock)
+{
+	// Chunks overlap by one level so that each chunk knows which of
+	// the chunks below it are empty, a chunk root's count is in the chunk above
+	const int chunk_level = key.level == 0 ? 0 : ((key.level - 1) / ChunkDepths) * ChunkDepths;
+	return ensure_chunk(ancestor(key, chunk_level), lock);
+}
+
+bool
+HierarchyIndex::ensure_chunk(const Key& root, std::unique_lock<std::mutex>& lock)
+{
+	if (root.level > 0) {
+		if (!ensure_chunk(ancestor(root, root.level - ChunkDepths), lock)) {
+			return false;
+		}
+		if (!find(node_id(root))) {
+			// Not in the chunk above, so nothing below either
+			return false;
+		}
+	}
+
+	const uint64_t id = node_id(root);
+	for (;;) {
+		const ChunkState state = find_or_insert(id).chunk;
+		if (state == ChunkState::Loaded) {
+			return true;
+		}
+		if (state == ChunkState::Unloaded) {
+			break;
+		}
+		m_chunk_loaded.wait(lock);
+	}
+	find(id)->chunk = ChunkState::Loading;
+
+	Json::Value node;
+	lock.unlock();
+	try {
+		node = m_source.fetch(bounds_of(root), m_root_depth + root.level, m_root_depth + root.level + ChunkDepths + 1);
+	}
+	catch (...) {
+		lock.lock();
+		find(id)->chunk = ChunkState::Unloaded;
+		m_chunk_loaded.notify_all();
+		throw;
+	}
+	lock.lock();
+
+	// The root's own count already came with the chunk above
+	const uint64_t added = node.isObject() ? add_subtree(node, root, root.level + ChunkDepths, root.level > 0) : 0;
+	for (int level = root.level - 1; level >= 0; --level) {
+		find_or_insert(node_id(ancestor(root, level))).below += added;
+	}
+	find(id)->chunk = ChunkState::Loaded;
+	m_chunk_loaded.notify_all();
+	return true;
+}
+
+uint64_t
+HierarchyIndex::add_subtree(const Json::Value& node, const Key& key, const int last_level, const bool skip_self)
+{
+	const uint64_t n = node["n"].asUInt64();
+	uint64_t added = skip_self ? 0 : n;
+	if (key.level < last_level && key.level < MaxLevel) {
+		for (uint32_t i = 0; i < OctantKeys.size(); ++i) {
+			const Json::Value& child = node[OctantKeys[i]];
+			if (!child.isObject()) {
+				continue;
+			}
+			const Key child_key{ key.level + 1, 2 * key.x + (i & 1), 2 * key.y + ((i >> 1) & 1), 2 * key.z + ((i >> 2) & 1) };
+			added += add_subtree(child, child_key, last_level, false);
+		}
+	}
+
+	// Folded tiles gather the counts of all the nodes they cover
+	Entry& entry = find_or_insert(node_id(fold(key)));
+	if (!skip_self) {
+		entry.points += n;
+	}
+	entry.below += added;
+	return added;
+}
+
+HierarchyIndex::Entry*
+HierarchyIndex::find(const uint64_t id)
+{
+	const size_t mask = m_entries.size() - 1;
+	for (size_t i = slot_of(id, m_entries.size());; i = (i + 1) & mask) {
+		if (m_entries[i].id == id) {
+			return &m_entries[i];
+		}
+		if (m_entries[i].id == 0) {
+			return nullptr;
+		}
+	}
+}
+
+HierarchyIndex::Entry&
+HierarchyIndex::find_or_insert(const uint64_t id)
+{
+	// Kept at most half full so probes stay short
+	if (2 * (m_size + 1) > m_entries.size()) {
+		rehash(2 * m_entries.size());
+	}
+	const size_t mask = m_entries.size() - 1;
+	size_t i = slot_of(id, m_entries.size());
+	while (m_entries[i].id != id && m_entries[i].id != 0) {
+		i = (i + 1) & mask;
+	}
+	if (m_entries[i].id == 0) {
+		m_entries[i] = Entry{ id, 0, 0, ChunkState::Unloaded };
+		++m_size;
+	}
+	return m_entries[i];
+}
+
+void
+HierarchyIndex::rehash(const size_t capacity)
+{
+	std::vector<Entry> entries(capacity, Entry{ 0, 0, 0, ChunkState::Unloaded });
+	entries.swap(m_entries);
+	const size_t mask = capacity - 1;
+	for (const Entry& entry : entries) {
+		if (entry.id == 0) {
+			continue;
+		}
+		size_t i = slot_of(entry.id, capacity);
+		while (m_entries[i].id != 0) {
+			i = (i + 1) & mask;
+		}
+		m_entries[i] = entry;
+	}
+}
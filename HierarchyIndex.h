@@ -0,0 +1,99 @@
+#pragma once
+
+#include <condition_variable>
+#include <cstdint>
+#include <limits>
+#include <mutex>
+#include <vector>
+
+#include "GreyhoundHierarchy.h"
+
+// Point counts of the tiles below the root of a download, loaded lazily
+// from /hierarchy ChunkDepths levels at a time.
+//
+// Tiles are identified by their level below the root and their position
+// along each axis, folded to the way the download splits them: a quadtree
+// tile is a whole column, a flat tile is the whole root. Counts live in an
+// open addressing table keyed by the octree node id (1 << 3 * level | morton code),
+// so once a chunk is in, a lookup is a hash and a few probes.
+class HierarchyIndex
+{
+public:
+	enum class Split
+	{
+		Flat,
+		Quadtree,
+		Octree
+	};
+
+	static constexpr uint64_t UnknownPoints = std::numeric_limits<uint64_t>::max();
+	// Levels below a chunk's root asked in one request
+	static constexpr int ChunkDepths = 4;
+	// Deepest level a node id can hold
+	static constexpr int MaxLevel = 21;
+
+	HierarchyIndex(std::string resource_url, pdal::greyhound::Bounds root, int root_depth, Split split);
+
+	Split split() const { return m_split; }
+
+	// Points in b at depth. Tiles covering several cells add them up, tiles
+	// smaller than a cell get its share of the cell's points by volume.
+	// UnknownPoints if depth is out of the index or b spans too many cells.
+	// May block on a /hierarchy request and throws if it fails.
+	uint64_t points(const pdal::greyhound::Bounds& b, int depth);
+	// Points of the tile and of every tile below it whose chunk is loaded
+	uint64_t points_under(const pdal::greyhound::Bounds& b, int depth);
+
+private:
+	struct Key
+	{
+		int level;
+		uint32_t x;
+		uint32_t y;
+		uint32_t z;
+	};
+
+	enum class ChunkState : uint8_t
+	{
+		Unloaded,
+		Loading,
+		Loaded
+	};
+
+	struct Entry
+	{
+		// 0 marks a free slot, valid ids always have their level bit set
+		uint64_t id;
+		uint64_t points;
+		// points plus the points of the loaded tiles below
+		uint64_t below;
+		// Of the chunk rooted at this tile, only meaningful at multiples of ChunkDepths
+		ChunkState chunk;
+	};
+
+	bool key_of(const pdal::greyhound::Bounds& b, int depth, Key& key) const;
+	Key fold(Key key) const;
+	static Key ancestor(const Key& key, int level);
+	static uint64_t node_id(const Key& key);
+	pdal::greyhound::Bounds bounds_of(const Key& key) const;
+
+	// Loads the chunk holding the counts of key, false if key's subtree is known to be empty
+	bool ensure_loaded(const Key& key, std::unique_lock<std::mutex>& lock);
+	bool ensure_chunk(const Key& root, std::unique_lock<std::mutex>& lock);
+	// Adds the counts of node and its children, returns the points added
+	uint64_t add_subtree(const Json::Value& node, const Key& key, int last_level, bool skip_self);
+
+	Entry* find(uint64_t id);
+	Entry& find_or_insert(uint64_t id);
+	void rehash(size_t capacity);
+
+	GreyhoundHierarchy m_source;
+	pdal::greyhound::Bounds m_root;
+	int m_root_depth;
+	Split m_split;
+
+	std::mutex m_mutex;
+	std::condition_variable m_chunk_loaded;
+	std::vector<Entry> m_entries;
+	size_t m_size;
+};
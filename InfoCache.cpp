@@ -0,0 +1,66 @@
+#include <QCryptographicHash>
+#include <QFile>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include "InfoCache.h"
+
+namespace {
+
+bool
+write_file(const QString& path, const QByteArray& data)
+{
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly)) {
+		return false;
+	}
+	file.write(data);
+	return file.commit();
+}
+
+}
+
+InfoCache::InfoCache(const QString& root)
+	: m_dir(root)
+{
+	m_dir.mkpath(".");
+}
+
+bool
+InfoCache::load(const QUrl& url, QByteArray& body, QByteArray& etag) const
+{
+	QFile body_file(file_path(url, "json"));
+	if (!body_file.open(QIODevice::ReadOnly)) {
+		return false;
+	}
+	body = body_file.readAll();
+
+	QFile etag_file(file_path(url, "etag"));
+	etag = etag_file.open(QIODevice::ReadOnly) ? etag_file.readAll() : QByteArray();
+	return !body.isEmpty();
+}
+
+void
+InfoCache::store(const QUrl& url, const QByteArray& body, const QByteArray& etag) const
+{
+	// Dropping the etag first means a failed write costs a full answer at
+	// worst, never a 304 that would keep a stale body
+	QFile::remove(file_path(url, "etag"));
+	if (!write_file(file_path(url, "json"), body) || etag.isEmpty()) {
+		return;
+	}
+	write_file(file_path(url, "etag"), etag);
+}
+
+QString
+InfoCache::default_root()
+{
+	return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/qGreyhound/info";
+}
+
+QString
+InfoCache::file_path(const QUrl& url, const QString& extension) const
+{
+	const QByteArray key = QCryptographicHash::hash(url.toString().toUtf8(), QCryptographicHash::Sha1).toHex();
+	return m_dir.filePath(QString("%1.%2").arg(QString(key), extension));
+}
@@ -0,0 +1,25 @@
+#pragma once
+
+#include <QByteArray>
+#include <QDir>
+#include <QString>
+#include <QUrl>
+
+// Last /info answer of each resource with its ETag, so a reconnect can show
+// the resource at once and only revalidate it in the background.
+class InfoCache
+{
+public:
+	explicit InfoCache(const QString& root = default_root());
+
+	// False if the url was never seen
+	bool load(const QUrl& url, QByteArray& body, QByteArray& etag) const;
+	void store(const QUrl& url, const QByteArray& body, const QByteArray& etag) const;
+
+	static QString default_root();
+
+private:
+	QString file_path(const QUrl& url, const QString& extension) const;
+
+	QDir m_dir;
+};
@@ -1,26 +1,249 @@
 #include "PDALConverter.h"
 
+#include <algorithm>
 #include <array>
+#include <atomic>
+#include <exception>
+#include <functional>
+#include <mutex>
+
+#include <QtConcurrent>
+#include <QThreadPool>
 
-#include <ccScalarField.h>
 #include <ccColorScalesManager.h>
 
+#include "ConversionKernels.h"
+
 using DimId = pdal::Dimension::Id;
 
+// Number of points converted at once, small enough for the
+// intermediate columns to stay in cache
+constexpr size_t ChunkSize = 1 << 14;
+// Views with fewer points are converted by the calling thread alone
+constexpr size_t ParallelMinPoints = 1 << 20;
+// Points of a column converted by one thread at a time in a parallel conversion
+constexpr size_t SliceSize = 16 * ChunkSize;
+// Color shift of an Auto converter before any color was seen
+constexpr int UndetectedColorShift = -1;
+// Shift used while the depth is undetected, the standard 16 bit colors of LAS
+constexpr unsigned TentativeColorShift = 8;
+// Colored views, or points, never going above 255 it takes to settle on 8 bit colors
+constexpr unsigned EightBitMinViews = 4;
+constexpr uint64_t EightBitMinPoints = 1 << 16;
+
+static_assert(std::is_same<ScalarType, float>::value, "The conversion kernels work on float scalar fields");
+
+PDALConverter::PDALConverter()
+	: m_color_depth(ColorDepth::Auto)
+	, m_parallel(true)
+	, m_color_shift(std::make_shared<std::atomic<int>>(UndetectedColorShift))
+	, m_color_evidence(std::make_shared<ColorEvidence>())
+{}
+
 bool
 is_vector_zero(const CCVector3d& vec)
 {
 	return (vec - CCVector3d(0, 0, 0)).norm() < std::numeric_limits<double>::epsilon();
 }
 
-void
-PDALConverter::convert(const pdal::PointViewPtr view, const pdal::PointLayoutPtr layout, ccPointCloud *cloud)
+CCVector3*
+point_slot(ccPointCloud *cloud, const unsigned index)
 {
+	return const_cast<CCVector3*>(cloud->getPointPersistentPtr(index));
+}
 
-	if (!cloud || !cloud->reserve(view->size())) {
+template <typename Out>
+static void
+read_column_or_zero(const ViewSource& src, const DimColumn& col, const size_t begin, const size_t end, Out *out)
+{
+	if (col.valid()) {
+		read_column(src, col, begin, end, out);
+	}
+	else {
+		std::fill(out, out + (end - begin), Out(0));
+	}
+}
+
+// Dimensions a float can't hold exactly are written relative to their first
+// value, the subtraction being done in double before narrowing
+static bool
+needs_shift(const DimColumn& col)
+{
+	using Type = pdal::Dimension::Type;
+	switch (col.type)
+	{
+	case Type::Signed32:
+	case Type::Unsigned32:
+	case Type::Signed64:
+	case Type::Unsigned64:
+	case Type::Double:
+		return true;
+	default:
+		return col.id == DimId::GpsTime;
+	}
+}
+
+static double
+first_value(const ViewSource& src, const DimColumn& col)
+{
+	double value = 0;
+	if (src.size()) {
+		read_column(src, col, 0, 1, &value);
+	}
+	return value;
+}
+
+// Fills the points [begin, end) of the view for one column (xyz, colors or a scalar field)
+using ColumnJob = std::function<void(size_t begin, size_t end)>;
+
+// Runs every job over the points [0, count).
+// Large views of a parallel converter are cut into slices of every column, handed
+// out one by one to the threads of the global pool and to the calling thread, so
+// the threads done with the cheap columns help with the expensive ones.
+static void
+run_jobs(const std::vector<ColumnJob>& jobs, const size_t count, const bool parallel)
+{
+	if (!parallel || count < ParallelMinPoints || QThreadPool::globalInstance()->maxThreadCount() < 2) {
+		for (const auto& job : jobs) {
+			job(0, count);
+		}
 		return;
 	}
 
+	struct Slice
+	{
+		const ColumnJob *job;
+		size_t begin;
+		size_t end;
+	};
+	std::vector<Slice> slices;
+	for (const auto& job : jobs) {
+		for (size_t begin = 0; begin < count; begin += SliceSize) {
+			slices.push_back({ &job, begin, std::min(begin + SliceSize, count) });
+		}
+	}
+
+	std::mutex mu_error;
+	std::exception_ptr error(nullptr);
+	QtConcurrent::blockingMap(slices, [&](const Slice& slice) {
+		try {
+			(*slice.job)(slice.begin, slice.end);
+		}
+		catch (...) {
+			std::lock_guard<std::mutex> lk(mu_error);
+			if (!error) {
+				error = std::current_exception();
+			}
+		}
+	});
+	if (error) {
+		std::rethrow_exception(error);
+	}
+}
+
+// Writes the colors of the points [range_begin, range_end) of the view from first_index,
+// narrowing 16 bit channels by shift bits. With scan, returns the largest value read.
+static uint16_t
+write_rgb(const ViewSource& src, const pdal::PointLayoutPtr layout, ccPointCloud *out_cloud, const unsigned first_index, const unsigned shift, const bool scan, const size_t range_begin, const size_t range_end)
+{
+	const std::array<DimColumn, 3> cols{
+		resolve_column(layout, DimId::Red),
+		resolve_column(layout, DimId::Green),
+		resolve_column(layout, DimId::Blue)
+	};
+	std::vector<uint16_t> rgb_16(ChunkSize);
+	std::array<std::vector<uint8_t>, 3> rgb_8;
+	for (auto& channel : rgb_8) {
+		channel.resize(ChunkSize);
+	}
+
+	uint16_t max = 0;
+	std::array<ColorCompType, 3> rgb{ 0,0,0 };
+	for (size_t begin = range_begin; begin < range_end; begin += ChunkSize) {
+		const size_t end = std::min(begin + ChunkSize, range_end);
+		for (size_t c = 0; c < cols.size(); ++c) {
+			if (pdal::Dimension::size(cols[c].type) == 1) {
+				read_column(src, cols[c], begin, end, rgb_8[c].data());
+				continue;
+			}
+			read_column(src, cols[c], begin, end, rgb_16.data());
+			if (scan) {
+				max = std::max(max, Kernels::narrow_u16_to_u8_max(rgb_16.data(), end - begin, shift, rgb_8[c].data()));
+			}
+			else {
+				Kernels::narrow_u16_to_u8(rgb_16.data(), end - begin, shift, rgb_8[c].data());
+			}
+		}
+
+		for (size_t i = 0; i < end - begin; ++i) {
+			rgb[0] = static_cast<ColorCompType>(rgb_8[0][i]);
+			rgb[1] = static_cast<ColorCompType>(rgb_8[1][i]);
+			rgb[2] = static_cast<ColorCompType>(rgb_8[2][i]);
+			out_cloud->setPointColor(static_cast<unsigned>(first_index + begin + i), rgb.data());
+		}
+	}
+	return max;
+}
+
+static void
+update_max(std::atomic<unsigned>& max, const unsigned value)
+{
+	unsigned current = max.load();
+	while (value > current && !max.compare_exchange_weak(current, value)) {
+	}
+}
+
+// The job writing the colors of the view. While the depth is undetected
+// they are narrowed from 16 bits and max gets the largest channel value.
+static ColumnJob
+rgb_job(const ViewSource& src, const pdal::PointLayoutPtr layout, ccPointCloud *cloud, const unsigned first_index, const int shift, std::atomic<unsigned>& max)
+{
+	if (shift == UndetectedColorShift) {
+		return [&src, layout, cloud, first_index, &max](const size_t begin, const size_t end) {
+			update_max(max, write_rgb(src, layout, cloud, first_index, TentativeColorShift, true, begin, end));
+		};
+	}
+	return [&src, layout, cloud, first_index, shift](const size_t begin, const size_t end) {
+		write_rgb(src, layout, cloud, first_index, static_cast<unsigned>(shift), false, begin, end);
+	};
+}
+
+// Gives colors to all the points of the cloud, false if it has none or memory ran out
+static bool
+allocate_rgb(ccPointCloud *cloud)
+{
+	if (!cloud->size()) {
+		return false;
+	}
+	if (!cloud->hasColors() && !cloud->resizeTheRGBTable(false)) {
+		ccLog::Error("Failed to allocate memory for the colors.");
+		return false;
+	}
+	return true;
+}
+
+static void
+add_scalar_field(ccPointCloud *cloud, ccScalarField *sf, const DimId id)
+{
+	const int sf_index = cloud->addScalarField(sf);
+	if (id == DimId::Intensity) {
+		sf->setColorScale(ccColorScalesManager::GetDefaultScale(ccColorScalesManager::GREY));
+		cloud->setCurrentDisplayedScalarField(sf_index);
+		cloud->showSF(true);
+	}
+}
+
+int
+PDALConverter::convert(const pdal::PointViewPtr view, const pdal::PointLayoutPtr layout, ccPointCloud *cloud)
+{
+	if (!cloud || !cloud->reserve(view->size())) {
+		return effective_color_shift();
+	}
+
+	const ViewSource src(view);
+	unsigned first_index = 0;
+	std::vector<ColumnJob> jobs;
+
 	if (layout->hasDim(DimId::X) || layout->hasDim(DimId::Y) || layout->hasDim(DimId::Z)) {
 		if (is_vector_zero(m_shift)) {
 			pdal::BOX3D bounds;
@@ -28,97 +251,326 @@ PDALConverter::convert(const pdal::PointViewPtr view, const pdal::PointLayoutPtr
 			m_shift = CCVector3d(bounds.minx, bounds.miny, bounds.minz);
 		}
 
-		for (size_t i = 0; i < view->size(); ++i) {
-			cloud->addPoint(CCVector3(
-				view->getFieldAs<double>(DimId::X, i) - m_shift.x,
-				view->getFieldAs<double>(DimId::Y, i) - m_shift.y,
-				view->getFieldAs<double>(DimId::Z, i) - m_shift.z
-			));
+		first_index = cloud->size();
+		if (!cloud->resize(first_index + static_cast<unsigned>(view->size()))) {
+			ccLog::Error("Failed to allocate memory for the points.");
+			return effective_color_shift();
 		}
 		cloud->setGlobalShift(-m_shift);
+		jobs.push_back([this, &src, layout, cloud, first_index](const size_t begin, const size_t end) {
+			convert_xyz(src, layout, cloud, first_index, begin, end);
+		});
+	}
+
+	const bool colors = has_all_colors(layout) && allocate_rgb(cloud);
+	const int effective_shift = effective_color_shift();
+	const int color_shift = colors ? this->color_shift(layout) : 0;
+	std::atomic<unsigned> color_max(0);
+	if (colors) {
+		jobs.push_back(rgb_job(src, layout, cloud, first_index, color_shift, color_max));
 	}
 
-	pdal::Dimension::IdList color_ids{ DimId::Red, DimId::Green, DimId::Blue };
-	bool has_all_colors = true;
-	for (auto color_id : color_ids) {
-		if (!view->hasDim(color_id)) {
-			has_all_colors = false;
-			break;
+	// Fields are allocated up front, the jobs only fill them. The points appended
+	// to a cloud that has the field already go at the end of it.
+	std::vector<std::pair<DimId, ccScalarField*>> fields;
+	std::vector<ccScalarField*> grown_fields;
+	for (auto id : layout->dims()) {
+		if (!is_scalar_field(layout, id)) {
+			continue;
+		}
+		const std::string name = layout->dimName(id);
+		const int existing = cloud->getScalarFieldIndexByName(name.c_str());
+		auto sf = existing >= 0 ? static_cast<ccScalarField*>(cloud->getScalarField(existing)) : new ccScalarField(name.c_str());
+		if (!sf->resize(first_index + static_cast<unsigned>(src.size()))) {
+			ccLog::Error(QString("Failed to allocate memory for the scalar field %1").arg(sf->getName()));
+			if (existing < 0) {
+				sf->release();
+			}
+			continue;
+		}
+		const DimColumn col = resolve_column(layout, id);
+		// The values already in the field were written with its shift
+		const double shift = existing >= 0 ? sf->getGlobalShift() : needs_shift(col) ? first_value(src, col) : 0;
+		if (existing >= 0) {
+			grown_fields.push_back(sf);
 		}
+		else {
+			sf->setGlobalShift(shift);
+			fields.emplace_back(id, sf);
+		}
+		jobs.push_back([&src, col, sf, first_index, shift](const size_t begin, const size_t end) {
+			write_scalar_field(src, col, sf, first_index, shift, begin, end);
+		});
 	}
 
-	if (has_all_colors) {
-		convert_rgb(view, cloud);
+	int applied_shift = effective_shift;
+	try {
+		run_jobs(jobs, src.size(), m_parallel);
+		if (color_shift == UndetectedColorShift) {
+			applied_shift = settle_color_shift(src, layout, cloud, first_index, static_cast<uint16_t>(color_max.load()));
+		}
+	}
+	catch (...) {
+		for (const auto& field : fields) {
+			field.second->release();
+		}
+		throw;
+	}
+
+	if (colors) {
+		cloud->showColors(true);
+	}
+	for (const auto& field : fields) {
+		field.second->computeMinAndMax();
+		add_scalar_field(cloud, field.second, field.first);
+	}
+	for (auto sf : grown_fields) {
+		sf->computeMinAndMax();
+	}
+	return applied_shift;
+}
+
+void
+PDALConverter::convert_xyz(const ViewSource& src, const pdal::PointLayoutPtr layout, ccPointCloud *out_cloud, const unsigned first_index, const size_t range_begin, const size_t range_end) const
+{
+	const DimColumn x_col = resolve_column(layout, DimId::X);
+	const DimColumn y_col = resolve_column(layout, DimId::Y);
+	const DimColumn z_col = resolve_column(layout, DimId::Z);
+
+	const double shift[3]{ m_shift.x, m_shift.y, m_shift.z };
+	std::vector<double> x(ChunkSize), y(ChunkSize), z(ChunkSize);
+	std::vector<float> xyz(3 * ChunkSize);
+	for (size_t begin = range_begin; begin < range_end; begin += ChunkSize) {
+		const size_t end = std::min(begin + ChunkSize, range_end);
+		read_column_or_zero(src, x_col, begin, end, x.data());
+		read_column_or_zero(src, y_col, begin, end, y.data());
+		read_column_or_zero(src, z_col, begin, end, z.data());
+
+		if (std::is_same<PointCoordinateType, float>::value) {
+			Kernels::shift_and_narrow_xyz(x.data(), y.data(), z.data(), end - begin, shift, xyz.data());
+			for (size_t i = 0; i < end - begin; ++i) {
+				*point_slot(out_cloud, static_cast<unsigned>(first_index + begin + i)) = CCVector3(xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2]);
+			}
+		}
+		else {
+			for (size_t i = 0; i < end - begin; ++i) {
+				*point_slot(out_cloud, static_cast<unsigned>(first_index + begin + i)) = CCVector3(
+					static_cast<PointCoordinateType>(x[i] - m_shift.x),
+					static_cast<PointCoordinateType>(y[i] - m_shift.y),
+					static_cast<PointCoordinateType>(z[i] - m_shift.z)
+				);
+			}
+		}
+	}
+}
+
+void
+PDALConverter::write_scalar_field(const ViewSource& src, const DimColumn& col, ccScalarField *sf, const unsigned first_index, const double shift, const size_t range_begin, const size_t range_end)
+{
+	std::vector<ScalarType> values(ChunkSize);
+	std::vector<double> wide(shift != 0 ? ChunkSize : 0);
+	for (size_t begin = range_begin; begin < range_end; begin += ChunkSize) {
+		const size_t end = std::min(begin + ChunkSize, range_end);
+		const size_t count = end - begin;
+		if (shift == 0) {
+			read_column(src, col, begin, end, values.data());
+		}
+		else {
+			read_column(src, col, begin, end, wide.data());
+			Kernels::shift_and_narrow(wide.data(), count, shift, values.data());
+		}
+		for (size_t i = 0; i < count; ++i) {
+			sf->setValue(first_index + begin + i, values[i]);
+		}
+	}
+}
+
+int
+PDALConverter::color_shift(const pdal::PointLayoutPtr layout) const
+{
+	// One byte channels are read as they are
+	if (pdal::Dimension::size(layout->dimType(DimId::Red)) == 1) {
+		return 0;
+	}
+	return effective_color_shift();
+}
+
+int
+PDALConverter::settle_color_shift(const ViewSource& src, const pdal::PointLayoutPtr layout, ccPointCloud *cloud, const unsigned first_index, const uint16_t max) const
+{
+	// Black points look the same whatever the depth, leave it to the next view
+	if (max == 0) {
+		return TentativeColorShift;
+	}
+	bool settled = true;
+	if (max <= 0xFF) {
+		const uint64_t points = m_color_evidence->points += src.size();
+		const unsigned views = ++m_color_evidence->views;
+		settled = views >= EightBitMinViews || points >= EightBitMinPoints;
+	}
+	const int detected = max > 0xFF ? 8 : 0;
+	int shift = UndetectedColorShift;
+	if (!settled) {
+		shift = m_color_shift->load();
+	}
+	else if (m_color_shift->compare_exchange_strong(shift, detected)) {
+		ccLog::Print(QString("[qGreyhound] colors detected as %1 bits").arg(detected ? 16 : 8));
+		shift = detected;
+	}
+	// Until it settles the view keeps its own reading, recolor() narrows it
+	// later if the colors turn out to be 16 bit ones after all
+	if (shift == UndetectedColorShift) {
+		shift = detected;
+	}
+	// Another view may have settled it first, in any case the colors must follow
+	if (shift != static_cast<int>(TentativeColorShift)) {
+		std::atomic<unsigned> unused(0);
+		run_jobs({ rgb_job(src, layout, cloud, first_index, shift, unused) }, src.size(), m_parallel);
+	}
+	return shift;
+}
+
+void
+PDALConverter::note_cached_color_shift(const int shift) const
+{
+	// Only colors above 255 are written with the 16 bit shift in Auto mode
+	int undetected = UndetectedColorShift;
+	if (m_color_depth == ColorDepth::Auto && shift == static_cast<int>(TentativeColorShift)
+		&& m_color_shift->compare_exchange_strong(undetected, shift)) {
+		ccLog::Print("[qGreyhound] colors detected as 16 bits");
 	}
-	convert_scalar_fields(view, layout, cloud);
 }
 
 void
-PDALConverter::convert_rgb(const pdal::PointViewPtr view, ccPointCloud *out_cloud)
+PDALConverter::recolor(ccPointCloud *cloud, const unsigned first_index, const unsigned count, const int from_shift, const int to_shift)
 {
-	if (!out_cloud->size()) {
+	if (from_shift < 0 || to_shift <= from_shift || !cloud->hasColors()) {
 		return;
 	}
-	if (!out_cloud->reserveTheRGBTable()) {
-		ccLog::Error("Failed to allocate memory for the colors.");
+	const unsigned end = std::min<unsigned>(first_index + count, cloud->size());
+	for (unsigned i = first_index; i < end; ++i) {
+		const ColorCompType *color = cloud->getPointColor(i);
+		std::array<ColorCompType, 3> rgb;
+		for (size_t c = 0; c < rgb.size(); ++c) {
+			rgb[c] = static_cast<ColorCompType>(color[c] >> (to_shift - from_shift));
+		}
+		cloud->setPointColor(i, rgb.data());
 	}
-	else
-	{
-		std::array<uint16_t, 3> rgb_16{ 0,0,0 };
-		std::array<ColorCompType, 3> rgb{ 0,0,0 };
-		for (size_t i = 0; i < view->size(); ++i) {
-			rgb_16[0] = view->getFieldAs<uint16_t>(DimId::Red, i);
-			rgb_16[1] = view->getFieldAs<uint16_t>(DimId::Green, i);
-			rgb_16[2] = view->getFieldAs<uint16_t>(DimId::Blue, i);
+}
 
-			//TODO: Some resources may not have colors coded on the 16 bits
-			// thus not requiring the shift
-			rgb[0] = static_cast<ColorCompType>(rgb_16[0] >> 8);
-			rgb[1] = static_cast<ColorCompType>(rgb_16[1] >> 8);
-			rgb[2] = static_cast<ColorCompType>(rgb_16[2] >> 8);
-			out_cloud->addRGBColor(rgb.data());
+bool
+PDALConverter::can_convert_into(const pdal::PointLayoutPtr layout, const ccPointCloud *cloud)
+{
+	for (auto id : layout->dims()) {
+		if (is_scalar_field(layout, id) && cloud->getScalarFieldIndexByName(layout->dimName(id).c_str()) < 0) {
+			return false;
 		}
-		out_cloud->showColors(true);
 	}
+	return !has_all_colors(layout) || cloud->hasColors();
 }
 
-void
-PDALConverter::convert_scalar_fields(const pdal::PointViewPtr view, const pdal::PointLayoutPtr layout, ccPointCloud* out_cloud)
+bool
+PDALConverter::prepare_into(const pdal::PointViewPtr view, const pdal::PointLayoutPtr layout, ccPointCloud *cloud)
 {
-	for (auto id : view->dims()) {
-		if (id == DimId::X || id == DimId::Y || id == DimId::Z) {
+	if (has_all_colors(layout) && !cloud->hasColors()) {
+		if (!cloud->resizeTheRGBTable(false)) {
+			ccLog::Error("Failed to allocate memory for the colors.");
+			return false;
+		}
+		cloud->showColors(true);
+	}
+
+	for (auto id : layout->dims()) {
+		if (!is_scalar_field(layout, id) || cloud->getScalarFieldIndexByName(layout->dimName(id).c_str()) >= 0) {
 			continue;
 		}
 		auto sf = new ccScalarField(layout->dimName(id).c_str());
-		sf->reserve(view->size());
-
-		for (size_t i = 0; i < view->size(); ++i) {
-			auto value = view->getFieldAs<ScalarType>(id, i);
-			sf->addElement(value);
+		if (!sf->resize(cloud->size())) {
+			ccLog::Error(QString("Failed to allocate memory for the scalar field %1").arg(sf->getName()));
+			sf->release();
+			return false;
 		}
+		const DimColumn col = resolve_column(layout, id);
+		if (needs_shift(col)) {
+			sf->setGlobalShift(first_value(ViewSource(view), col));
+		}
+		add_scalar_field(cloud, sf, id);
+	}
+	return true;
+}
 
-		sf->computeMinAndMax();
+int
+PDALConverter::convert_into(const pdal::PointViewPtr view, const pdal::PointLayoutPtr layout, ccPointCloud *cloud, const unsigned first_index) const
+{
+	assert(first_index + view->size() <= cloud->size());
+	const ViewSource src(view);
+	std::vector<ColumnJob> jobs;
 
-		const int sf_index = out_cloud->addScalarField(sf);
-		if (id == DimId::Intensity) {
-			sf->setColorScale(ccColorScalesManager::GetDefaultScale(ccColorScalesManager::GREY));
-			out_cloud->setCurrentDisplayedScalarField(sf_index);
-			out_cloud->showSF(true);
-		}
+	if (layout->hasDim(DimId::X) || layout->hasDim(DimId::Y) || layout->hasDim(DimId::Z)) {
+		jobs.push_back([this, &src, layout, cloud, first_index](const size_t begin, const size_t end) {
+			convert_xyz(src, layout, cloud, first_index, begin, end);
+		});
+	}
 
-		if (id == DimId::GpsTime) {
-			const ScalarType min = sf->getMin();
-			for (size_t i(0); i < sf->currentSize(); ++i) {
-				sf->setValue(i, sf->getValue(i) - min);
-			}
-			sf->setGlobalShift(min);
-			sf->computeMinAndMax();
+	const int effective_shift = effective_color_shift();
+	const int color_shift = has_all_colors(layout) ? this->color_shift(layout) : 0;
+	std::atomic<unsigned> color_max(0);
+	if (has_all_colors(layout)) {
+		jobs.push_back(rgb_job(src, layout, cloud, first_index, color_shift, color_max));
+	}
+
+	for (auto id : layout->dims()) {
+		if (!is_scalar_field(layout, id)) {
+			continue;
 		}
+		const int sf_index = cloud->getScalarFieldIndexByName(layout->dimName(id).c_str());
+		auto sf = static_cast<ccScalarField*>(cloud->getScalarField(sf_index));
+		const DimColumn col = resolve_column(layout, id);
+		// Reuse the shift the first tiles gave the field so all tiles agree
+		const double shift = sf->getGlobalShift();
+		jobs.push_back([&src, col, sf, first_index, shift](const size_t begin, const size_t end) {
+			write_scalar_field(src, col, sf, first_index, shift, begin, end);
+		});
+	}
 
+	run_jobs(jobs, src.size(), m_parallel);
+	if (color_shift == UndetectedColorShift) {
+		return settle_color_shift(src, layout, cloud, first_index, static_cast<uint16_t>(color_max.load()));
 	}
+	return effective_shift;
 }
 
 void PDALConverter::set_shift(const CCVector3d shift)
 {
 	m_shift = shift;
+}
+
+CCVector3d PDALConverter::shift() const
+{
+	return m_shift;
+}
+
+void PDALConverter::set_color_depth(const ColorDepth depth)
+{
+	m_color_depth = depth;
+}
+
+PDALConverter::ColorDepth PDALConverter::color_depth() const
+{
+	return m_color_depth;
+}
+
+int PDALConverter::effective_color_shift() const
+{
+	switch (m_color_depth)
+	{
+	case ColorDepth::Bits8: return 0;
+	case ColorDepth::Bits16: return 8;
+	default: return m_color_shift->load();
+	}
+}
+
+void PDALConverter::set_parallel(const bool parallel)
+{
+	m_parallel = parallel;
 }
\ No newline at end of file
@@ -1,21 +1,91 @@
 #pragma once
 
+#include <atomic>
+#include <memory>
+
 #include <pdal/pdal.hpp>
 
 #include <ccPointCloud.h>
+#include <ccScalarField.h>
+
+#include "PointColumns.h"
+
+// ccPointCloud only gives const access to its points,
+// but once resized the slots are ours to fill.
+CCVector3* point_slot(ccPointCloud *cloud, unsigned index);
 
 
 class PDALConverter {
 public:
-	PDALConverter() = default;
-	void convert(pdal::PointViewPtr, pdal::PointLayoutPtr, ccPointCloud *cloud);
+	// Bits per color channel. Auto takes one byte channels as they are and reads two
+	// byte ones as 16 bit colors, as LAS has them, until the views converted tell:
+	// a value above 255 settles 16 bits, while 8 bits, which dark 16 bit colors look
+	// like, is only settled once 4 views or 65536 colored points never went above 255.
+	// Views converted before that are written as 8 bit colors, which recolor() narrows
+	// once 16 bits settle. Copies of a converter share what they detected.
+	enum class ColorDepth
+	{
+		Auto,
+		Bits8,
+		Bits16
+	};
+
+	PDALConverter();
+	// Views of more than a million points or so are converted by several
+	// threads of the global pool, each taking slices of the columns, unless
+	// the converter is not parallel. Both conversions return the
+	// effective_color_shift the colors of the view were written with.
+	int convert(pdal::PointViewPtr, pdal::PointLayoutPtr, ccPointCloud *cloud);
+	// Converts into the points [first_index, first_index + view->size()) of a cloud
+	// already sized for them, whose colors and scalar fields exist (see can_convert_into).
+	// Different workers may convert into disjoint ranges of the same cloud at once.
+	int convert_into(pdal::PointViewPtr, pdal::PointLayoutPtr, ccPointCloud *cloud, unsigned first_index) const;
+	static bool can_convert_into(pdal::PointLayoutPtr, const ccPointCloud *cloud);
+	// Adds the colors and scalar fields of the layout the cloud lacks, for all its points,
+	// so that convert_into can fill them. New fields a float can't hold exactly, GpsTime and
+	// 32 and 64 bit dimensions, are shifted by the view's first value.
+	static bool prepare_into(pdal::PointViewPtr, pdal::PointLayoutPtr, ccPointCloud *cloud);
 	void set_shift(CCVector3d shift);
+	CCVector3d shift() const;
+	void set_color_depth(ColorDepth depth);
+	ColorDepth color_depth() const;
+	// Bits two byte colors are shifted right by, negative while Auto has not settled.
+	int effective_color_shift() const;
+	// Lets an Auto converter settle from a tile written with shift by an earlier one,
+	// as a tile loaded from the cache is never converted.
+	void note_cached_color_shift(int shift) const;
+	// Narrows the colors of [first_index, first_index + count) written with from_shift
+	// to to_shift, for views converted before the depth settled. Does nothing unless
+	// both are known and to_shift is larger.
+	static void recolor(ccPointCloud *cloud, unsigned first_index, unsigned count, int from_shift, int to_shift);
+	// Off for converters run side by side on threads of their own, which
+	// already keep the cores busy one view each. On by default.
+	void set_parallel(bool parallel);
 
 
 private:
-	static void convert_rgb(pdal::PointViewPtr, ccPointCloud *out_cloud);
-	static void convert_scalar_fields(pdal::PointViewPtr, pdal::PointLayoutPtr, ccPointCloud*);
+	// The writers fill the points [begin, end) of the view, starting at first_index in the cloud.
+	// Concurrent calls on disjoint ranges are safe.
+	void convert_xyz(const ViewSource& src, pdal::PointLayoutPtr, ccPointCloud *out_cloud, unsigned first_index, size_t begin, size_t end) const;
+	// Writes col - shift into sf, in a single pass over the column
+	static void write_scalar_field(const ViewSource& src, const DimColumn& col, ccScalarField *sf, unsigned first_index, double shift, size_t begin, size_t end);
+	// Bits the colors of the layout are shifted right by, negative while undetected
+	int color_shift(pdal::PointLayoutPtr) const;
+	// Settles an undetected depth from the largest channel value of a view converted
+	// as 16 bit colors, converting its colors again if they were 8 bit after all, or
+	// may be while it is not settled. Returns the shift its colors end up with.
+	int settle_color_shift(const ViewSource& src, pdal::PointLayoutPtr, ccPointCloud *cloud, unsigned first_index, uint16_t max) const;
 
 private:
 	CCVector3d m_shift;
+	ColorDepth m_color_depth;
+	bool m_parallel;
+	std::shared_ptr<std::atomic<int>> m_color_shift;
+	// What the views below 256 said so far, while the color depth is undetected
+	struct ColorEvidence
+	{
+		std::atomic<uint64_t> points{ 0 };
+		std::atomic<unsigned> views{ 0 };
+	};
+	std::shared_ptr<ColorEvidence> m_color_evidence;
 };
\ No newline at end of file
@@ -0,0 +1,162 @@
+#pragma once
+
+#include <cstring>
+#include <stdexcept>
+
+#include <pdal/pdal.hpp>
+
+// Where a dimension lives inside a packed point, resolved once per view
+// instead of once per getFieldAs call.
+struct DimColumn
+{
+	DimColumn()
+		: id(pdal::Dimension::Id::Unknown)
+		, type(pdal::Dimension::Type::None)
+		, offset(0)
+	{}
+
+	DimColumn(pdal::Dimension::Id id, pdal::Dimension::Type type, size_t offset)
+		: id(id)
+		, type(type)
+		, offset(offset)
+	{}
+
+	bool valid() const { return type != pdal::Dimension::Type::None; }
+
+	pdal::Dimension::Id id;
+	pdal::Dimension::Type type;
+	size_t offset;
+};
+
+inline DimColumn
+resolve_column(const pdal::PointLayoutPtr layout, const pdal::Dimension::Id id)
+{
+	const pdal::Dimension::Detail *detail = layout->dimDetail(id);
+	if (!detail || !layout->hasDim(id)) {
+		return {};
+	}
+	return { id, detail->type(), static_cast<size_t>(detail->offset()) };
+}
+
+// Gives access to the packed bytes of each point of a PointView
+class ViewSource
+{
+public:
+	explicit ViewSource(pdal::PointViewPtr view)
+		: m_view(std::move(view))
+	{}
+
+	size_t size() const { return m_view->size(); }
+	const char* point(size_t i) const { return m_view->getPoint(i); }
+
+private:
+	pdal::PointViewPtr m_view;
+};
+
+// Whether the layout has all three colour dimensions, which become
+// the cloud's colours rather than scalar fields
+inline bool
+has_all_colors(const pdal::PointLayoutPtr layout)
+{
+	using Id = pdal::Dimension::Id;
+	return layout->hasDim(Id::Red) && layout->hasDim(Id::Green) && layout->hasDim(Id::Blue);
+}
+
+// Whether id is converted into a scalar field: not a position,
+// nor a colour channel already turned into colours
+inline bool
+is_scalar_field(const pdal::PointLayoutPtr layout, const pdal::Dimension::Id id)
+{
+	using Id = pdal::Dimension::Id;
+	if (id == Id::X || id == Id::Y || id == Id::Z) {
+		return false;
+	}
+	return !((id == Id::Red || id == Id::Green || id == Id::Blue) && has_all_colors(layout));
+}
+
+template <typename In, typename Out, typename Source>
+void
+read_column_as(const Source& src, const size_t offset, const size_t begin, const size_t end, Out *out)
+{
+	In value;
+	for (size_t i = begin; i < end; ++i) {
+		std::memcpy(&value, src.point(i) + offset, sizeof(In));
+		out[i - begin] = static_cast<Out>(value);
+	}
+}
+
+template <typename Out, typename Source>
+using ColumnReader = void (*)(const Source&, size_t, size_t, size_t, Out*);
+
+// read_column_as instantiated for every pdal type, indexed by
+// 4 * (signed, unsigned, floating) + log2(size in bytes)
+template <typename Out, typename Source>
+struct ColumnReaders
+{
+	static constexpr size_t Size = 12;
+	static constexpr ColumnReader<Out, Source> table[Size] = {
+		&read_column_as<int8_t, Out, Source>,
+		&read_column_as<int16_t, Out, Source>,
+		&read_column_as<int32_t, Out, Source>,
+		&read_column_as<int64_t, Out, Source>,
+		&read_column_as<uint8_t, Out, Source>,
+		&read_column_as<uint16_t, Out, Source>,
+		&read_column_as<uint32_t, Out, Source>,
+		&read_column_as<uint64_t, Out, Source>,
+		nullptr,
+		nullptr,
+		&read_column_as<float, Out, Source>,
+		&read_column_as<double, Out, Source>
+	};
+};
+
+template <typename Out, typename Source>
+constexpr ColumnReader<Out, Source> ColumnReaders<Out, Source>::table[ColumnReaders<Out, Source>::Size];
+
+// The reader of a pdal type, nullptr if there is none
+template <typename Out, typename Source>
+ColumnReader<Out, Source>
+column_reader(const pdal::Dimension::Type type)
+{
+	using BaseType = pdal::Dimension::BaseType;
+	size_t base;
+	switch (pdal::Dimension::base(type))
+	{
+	case BaseType::Signed:   base = 0; break;
+	case BaseType::Unsigned: base = 1; break;
+	case BaseType::Floating: base = 2; break;
+	default:
+		return nullptr;
+	}
+	size_t log2_size;
+	switch (pdal::Dimension::size(type))
+	{
+	case 1: log2_size = 0; break;
+	case 2: log2_size = 1; break;
+	case 4: log2_size = 2; break;
+	case 8: log2_size = 3; break;
+	default:
+		return nullptr;
+	}
+	return ColumnReaders<Out, Source>::table[4 * base + log2_size];
+}
+
+// Copies the points [begin, end) of a column into out, converting to Out.
+// The reader is looked up once per column, its loop only knows one type.
+template <typename Out, typename Source>
+void
+read_column(const Source& src, const DimColumn& col, const size_t begin, const size_t end, Out *out)
+{
+	const ColumnReader<Out, Source> reader = column_reader<Out, Source>(col.type);
+	if (!reader) {
+		throw std::runtime_error("Unsupported dimension type");
+	}
+	reader(src, col.offset, begin, end, out);
+}
+
+template <typename Out, typename Source>
+void
+read_column(const Source& src, const DimColumn& col, Out *out)
+{
+	read_column(src, col, 0, src.size(), out);
+}
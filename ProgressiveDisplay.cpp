@@ -0,0 +1,108 @@
+#include <ccLog.h>
+
+#include "ProgressiveDisplay.h"
+
+using mutex_locker = std::lock_guard<std::mutex>;
+
+ProgressiveDisplay::ProgressiveDisplay(ccPointCloud *preview)
+	: m_preview(preview)
+	, m_watcher([this](const ccHObject*) { m_preview = nullptr; })
+	, m_time_to_first_points(-1)
+	, m_kept(0)
+	, m_stride(1)
+	, m_next_thinning(MaxPreviewPoints / 2)
+{
+	m_watcher.watch(m_preview);
+	m_timer.setInterval(FrameBudgetMs);
+	QObject::connect(&m_timer, &QTimer::timeout, [this]() { flush(); });
+}
+
+ProgressiveDisplay::~ProgressiveDisplay()
+{
+	if (m_preview) {
+		m_watcher.unwatch(m_preview);
+	}
+}
+
+void
+ProgressiveDisplay::start(const std::chrono::steady_clock::time_point requested)
+{
+	m_requested = requested;
+	m_time_to_first_points = -1;
+	m_timer.start();
+}
+
+void
+ProgressiveDisplay::stop()
+{
+	m_timer.stop();
+	flush();
+}
+
+void
+ProgressiveDisplay::stage(const ccPointCloud& cloud, const unsigned first_index, const unsigned count)
+{
+	mutex_locker lk(m_mutex);
+	const bool colored = cloud.hasColors();
+	size_t room = MaxPreviewPoints - m_kept;
+	for (unsigned i = first_index; i < first_index + count && room; i += m_stride, --room) {
+		CCVector3 p;
+		cloud.getPoint(i, p);
+		m_points.push_back(p);
+		if (colored) {
+			const ColorCompType *rgb = cloud.getPointColor(i);
+			m_colors.insert(m_colors.end(), rgb, rgb + 3);
+		}
+	}
+	m_kept = MaxPreviewPoints - room;
+
+	while (m_kept >= m_next_thinning && m_next_thinning < MaxPreviewPoints) {
+		m_stride *= 2;
+		m_next_thinning += (MaxPreviewPoints - m_next_thinning + 1) / 2;
+	}
+}
+
+double
+ProgressiveDisplay::time_to_first_points() const
+{
+	return m_time_to_first_points;
+}
+
+void
+ProgressiveDisplay::flush()
+{
+	std::vector<CCVector3> points;
+	std::vector<ColorCompType> colors;
+	{
+		mutex_locker lk(m_mutex);
+		points.swap(m_points);
+		colors.swap(m_colors);
+	}
+	if (points.empty() || !m_preview) {
+		return;
+	}
+
+	// The first batch decides whether the preview has colors
+	const bool batch_colored = colors.size() == 3 * points.size();
+	const bool colored = m_preview->size() == 0 ? batch_colored : m_preview->hasColors();
+	if (!m_preview->reserve(m_preview->size() + static_cast<unsigned>(points.size()))
+		|| (colored && !m_preview->reserveTheRGBTable())) {
+		ccLog::Warning("[qGreyhound] Not enough memory to display the points being downloaded");
+		return;
+	}
+	const ColorCompType white[3] = { ccColor::MAX, ccColor::MAX, ccColor::MAX };
+	for (size_t i = 0; i < points.size(); ++i) {
+		m_preview->addPoint(points[i]);
+		if (colored) {
+			m_preview->addRGBColor(batch_colored ? &colors[3 * i] : white);
+		}
+	}
+	m_preview->showColors(colored);
+
+	if (m_time_to_first_points < 0) {
+		m_time_to_first_points = std::chrono::duration<double>(std::chrono::steady_clock::now() - m_requested).count();
+	}
+
+	m_preview->prepareDisplayForRefresh();
+	m_preview->refreshDisplay();
+}
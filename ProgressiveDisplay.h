@@ -0,0 +1,60 @@
+#pragma once
+
+#include <chrono>
+#include <mutex>
+#include <vector>
+
+#include <QTimer>
+
+#include <ccPointCloud.h>
+
+#include "DeletionWatcher.h"
+
+// Shows the points of a download while it runs.
+// The downloading thread stages a decimated copy of the finished tiles and
+// the GUI thread moves them into a preview cloud, in batches, at a fixed
+// frame rate. The cloud being downloaded is never drawn meanwhile.
+class ProgressiveDisplay
+{
+public:
+	static constexpr int FrameBudgetMs = 200;
+	// The preview never holds more points than this. Every time it fills half
+	// of the room it has left, the tiles staged next are thinned twice as much,
+	// so the coarse depths, which come first, are shown the most densely.
+	static constexpr size_t MaxPreviewPoints = 2000000;
+
+	// preview must live in the GUI thread, it may be deleted from the DB meanwhile
+	explicit ProgressiveDisplay(ccPointCloud *preview);
+	~ProgressiveDisplay();
+
+	// requested is when the download was asked for, what time_to_first_points counts from
+	void start(std::chrono::steady_clock::time_point requested);
+	// Flushes what is left and stops the timer
+	void stop();
+
+	// Thread safe, copies part of the points [first_index, first_index + count) of cloud
+	void stage(const ccPointCloud& cloud, unsigned first_index, unsigned count);
+
+	// Null once the preview was deleted
+	ccPointCloud *preview() const { return m_preview; }
+	// Seconds between the request and the first points shown, negative if none were
+	double time_to_first_points() const;
+
+private:
+	// GUI thread only
+	void flush();
+
+	ccPointCloud *m_preview;
+	DeletionWatcher m_watcher;
+	QTimer m_timer;
+	std::chrono::steady_clock::time_point m_requested;
+	double m_time_to_first_points;
+
+	std::mutex m_mutex;
+	std::vector<CCVector3> m_points;
+	std::vector<ColorCompType> m_colors;
+	// Staged so far, and the decimation of the next tiles
+	size_t m_kept;
+	unsigned m_stride;
+	size_t m_next_thinning;
+};
@@ -0,0 +1,149 @@
+#include <algorithm>
+#include <cmath>
+#include <queue>
+
+#include "StreamingPlanner.h"
+
+using Bounds = pdal::greyhound::Bounds;
+
+ViewState
+make_view_state(const double *model_view, const double *projection, const int viewport_height, const bool perspective)
+{
+	// clip = projection * model_view, both column major
+	double clip[16];
+	for (int col = 0; col < 4; ++col) {
+		for (int row = 0; row < 4; ++row) {
+			double v = 0;
+			for (int k = 0; k < 4; ++k) {
+				v += projection[k * 4 + row] * model_view[col * 4 + k];
+			}
+			clip[col * 4 + row] = v;
+		}
+	}
+	const auto row = [&clip](const int r, const int c) { return clip[c * 4 + r]; };
+
+	ViewState view;
+	// Gribb & Hartmann: left, right, bottom, top, near, far
+	for (int i = 0; i < 6; ++i) {
+		const int axis = i / 2;
+		const double sign = (i % 2 == 0) ? 1.0 : -1.0;
+		for (int c = 0; c < 4; ++c) {
+			view.planes[i][c] = row(3, c) + sign * row(axis, c);
+		}
+	}
+
+	// The eye is where the model view sends the origin: -R^T * t
+	const double *t = model_view + 12;
+	view.eye = {
+		-(model_view[0] * t[0] + model_view[1] * t[1] + model_view[2] * t[2]),
+		-(model_view[4] * t[0] + model_view[5] * t[1] + model_view[6] * t[2]),
+		-(model_view[8] * t[0] + model_view[9] * t[1] + model_view[10] * t[2])
+	};
+
+	view.perspective = perspective;
+	// projection[5] is 1 / tan(fov / 2) in perspective, 2 / height in orthographic
+	view.pixels_per_unit = viewport_height * projection[5] / 2.0;
+	return view;
+}
+
+StreamingPlanner::StreamingPlanner(Bounds root, const int base_depth, const int max_depth, CCVector3d origin)
+	: m_root(std::move(root))
+	, m_base_depth(base_depth)
+	, m_max_depth(max_depth)
+	, m_origin(origin)
+{
+}
+
+TileKey
+StreamingPlanner::root_key() const
+{
+	return { m_base_depth, 0, 0, 0 };
+}
+
+Bounds
+StreamingPlanner::bounds(const TileKey& key) const
+{
+	const double n = std::ldexp(1.0, key.depth - m_base_depth);
+	const double sx = (m_root.max().x - m_root.min().x) / n;
+	const double sy = (m_root.max().y - m_root.min().y) / n;
+	const double sz = (m_root.max().z - m_root.min().z) / n;
+	return {
+		m_root.min().x + sx * key.x, m_root.min().y + sy * key.y, m_root.min().z + sz * key.z,
+		m_root.min().x + sx * (key.x + 1), m_root.min().y + sy * (key.y + 1), m_root.min().z + sz * (key.z + 1)
+	};
+}
+
+bool
+StreamingPlanner::visible(const TileKey& key, const ViewState& view) const
+{
+	const Bounds b = bounds(key);
+	const double lo[3] = { b.min().x - m_origin.x, b.min().y - m_origin.y, b.min().z - m_origin.z };
+	const double hi[3] = { b.max().x - m_origin.x, b.max().y - m_origin.y, b.max().z - m_origin.z };
+
+	// Outside as soon as the corner furthest along a plane's normal is behind it
+	for (const auto& p : view.planes) {
+		const double d = p[0] * (p[0] >= 0 ? hi[0] : lo[0])
+			+ p[1] * (p[1] >= 0 ? hi[1] : lo[1])
+			+ p[2] * (p[2] >= 0 ? hi[2] : lo[2])
+			+ p[3];
+		if (d < 0) {
+			return false;
+		}
+	}
+	return true;
+}
+
+double
+StreamingPlanner::screen_error(const TileKey& key, const ViewState& view) const
+{
+	const Bounds b = bounds(key);
+	const double spacing = (b.max().x - b.min().x) / PointsAcrossTile;
+	if (!view.perspective) {
+		return spacing * view.pixels_per_unit;
+	}
+
+	// Distance from the eye to the closest point of the tile
+	const double lo[3] = { b.min().x - m_origin.x, b.min().y - m_origin.y, b.min().z - m_origin.z };
+	const double hi[3] = { b.max().x - m_origin.x, b.max().y - m_origin.y, b.max().z - m_origin.z };
+	const double eye[3] = { view.eye.x, view.eye.y, view.eye.z };
+	double squared = 0;
+	for (int i = 0; i < 3; ++i) {
+		const double d = std::max(std::max(lo[i] - eye[i], 0.0), eye[i] - hi[i]);
+		squared += d * d;
+	}
+	// Inside the tile: as close as its own spacing
+	const double distance = std::max(std::sqrt(squared), spacing);
+	return spacing * view.pixels_per_unit / distance;
+}
+
+std::vector<PlannedTile>
+StreamingPlanner::plan(const ViewState& view, const double max_error, const size_t max_tiles,
+	const std::function<bool(const TileKey&)>& prune) const
+{
+	const auto larger_error = [](const PlannedTile& a, const PlannedTile& b) { return a.screen_error < b.screen_error; };
+	std::priority_queue<PlannedTile, std::vector<PlannedTile>, decltype(larger_error)> candidates(larger_error);
+
+	std::vector<PlannedTile> tiles;
+	const TileKey root = root_key();
+	if (!visible(root, view)) {
+		return tiles;
+	}
+	candidates.push({ root, bounds(root), screen_error(root, view) });
+
+	while (!candidates.empty() && tiles.size() < max_tiles) {
+		const PlannedTile tile = candidates.top();
+		candidates.pop();
+		tiles.push_back(tile);
+
+		if (tile.screen_error <= max_error || tile.key.depth >= m_max_depth || (prune && prune(tile.key))) {
+			continue;
+		}
+		for (uint32_t o = 0; o < 8; ++o) {
+			const TileKey child{ tile.key.depth + 1, 2 * tile.key.x + (o & 1), 2 * tile.key.y + ((o >> 1) & 1), 2 * tile.key.z + ((o >> 2) & 1) };
+			if (visible(child, view)) {
+				candidates.push({ child, bounds(child), screen_error(child, view) });
+			}
+		}
+	}
+	return tiles;
+}
@@ -0,0 +1,83 @@
+#pragma once
+
+#include <array>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include <vector>
+
+#include <CCGeom.h>
+
+#include <GreyhoundCommon.hpp>
+
+// An octree node of a resource: depth and integer position among
+// the 2^(depth - base depth) nodes per axis at that depth
+struct TileKey
+{
+	int depth;
+	uint32_t x;
+	uint32_t y;
+	uint32_t z;
+
+	bool operator<(const TileKey& other) const
+	{
+		if (depth != other.depth) return depth < other.depth;
+		if (x != other.x) return x < other.x;
+		if (y != other.y) return y < other.y;
+		return z < other.z;
+	}
+	bool operator==(const TileKey& other) const
+	{
+		return depth == other.depth && x == other.x && y == other.y && z == other.z;
+	}
+};
+
+// Where the camera looks from, in the local coordinates of the displayed clouds
+struct ViewState
+{
+	CCVector3d eye;
+	// a * x + b * y + c * z + d >= 0 inside the frustum
+	std::array<std::array<double, 4>, 6> planes;
+	bool perspective;
+	// Pixels covered by one metre, at one metre from the eye in perspective
+	double pixels_per_unit;
+};
+
+// Builds the view from the OpenGL matrices (column major) and viewport height
+ViewState make_view_state(const double *model_view, const double *projection, int viewport_height, bool perspective);
+
+struct PlannedTile
+{
+	TileKey key;
+	pdal::greyhound::Bounds b;
+	// Size on screen of the gap between two points of the tile, in pixels
+	double screen_error;
+};
+
+// Decides which tiles of a resource the current view needs
+class StreamingPlanner
+{
+public:
+	// Points along each axis of a tile, used to estimate its spacing
+	static constexpr double PointsAcrossTile = 128;
+
+	// root is the resource's cube at base_depth, origin what the clouds' global shift removes
+	StreamingPlanner(pdal::greyhound::Bounds root, int base_depth, int max_depth, CCVector3d origin);
+
+	pdal::greyhound::Bounds bounds(const TileKey& key) const;
+	TileKey root_key() const;
+
+	bool visible(const TileKey& key, const ViewState& view) const;
+	double screen_error(const TileKey& key, const ViewState& view) const;
+
+	// Visible tiles, largest error first, refined while their error is above max_error.
+	// Tiles for which prune returns true are kept but not refined.
+	std::vector<PlannedTile> plan(const ViewState& view, double max_error, size_t max_tiles,
+		const std::function<bool(const TileKey&)>& prune) const;
+
+private:
+	pdal::greyhound::Bounds m_root;
+	int m_base_depth;
+	int m_max_depth;
+	CCVector3d m_origin;
+};
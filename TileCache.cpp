@@ -0,0 +1,393 @@
+#include <cstring>
+#include <iterator>
+
+#include <QCryptographicHash>
+#include <QDateTime>
+#include <QFile>
+#include <QFileInfo>
+#include <QSaveFile>
+#include <QStandardPaths>
+
+#include <ccScalarField.h>
+#include <ccColorScalesManager.h>
+
+#include "TileCache.h"
+#include "PDALConverter.h"
+
+namespace {
+
+constexpr char TileMagic[4] = { 'Q', 'G', 'H', 'T' };
+// 2: colour channels are no longer duplicated as scalar fields
+// 3: 8 bit colours stored on 16 bits are no longer narrowed to black
+// 4: keyed by the color depth asked for, the header has the shift the colors were written with
+constexpr uint32_t TileVersion = 4;
+constexpr size_t ChunkSize = 1 << 14;
+
+// Layout of a tile file, every section starts on 8 bytes:
+// TileHeader, sf_count * (SfHeader, name), points as float xyz (if has_xyz),
+// colors as rgb bytes (if has_colors), sf_count * float values
+struct TileHeader
+{
+	char magic[4];
+	uint32_t version;
+	uint64_t point_count;
+	uint32_t has_xyz;
+	uint32_t has_colors;
+	uint32_t sf_count;
+	int32_t color_shift;
+};
+
+struct SfHeader
+{
+	double global_shift;
+	uint32_t name_size;
+	uint32_t reserved;
+};
+
+size_t
+padded(const size_t n)
+{
+	return (n + 7) & ~size_t(7);
+}
+
+QByteArray
+sha1_hex(const QByteArray& data)
+{
+	return QCryptographicHash::hash(data, QCryptographicHash::Sha1).toHex();
+}
+
+}
+
+CloudMark::CloudMark(const ccPointCloud& cloud)
+	: points(cloud.size())
+	, scalar_fields(cloud.getNumberOfScalarFields())
+	, colors(cloud.hasColors())
+{
+}
+
+TileCache::TileCache(const QString& resource_url, const QByteArray& info_digest, const qint64 max_bytes)
+	: m_dir(default_root() + "/" + sha1_hex(resource_url.toUtf8()))
+	, m_max_bytes(max_bytes)
+	, m_size_bytes(0)
+{
+	m_dir.mkpath(".");
+
+	QFile digest_file(m_dir.filePath("info.sha1"));
+	QByteArray cached_digest;
+	if (digest_file.open(QIODevice::ReadOnly)) {
+		cached_digest = digest_file.readAll();
+		digest_file.close();
+	}
+
+	const QStringList tiles = m_dir.entryList({ "*.tile" }, QDir::Files);
+	if (cached_digest != info_digest) {
+		// The resource changed since the tiles were stored
+		for (const auto& tile : tiles) {
+			m_dir.remove(tile);
+		}
+		if (digest_file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+			digest_file.write(info_digest);
+		}
+	}
+	else {
+		// Loads keep touching the files, so the oldest were the least recently used
+		for (const auto& info : m_dir.entryInfoList({ "*.tile" }, QDir::Files, QDir::Time | QDir::Reversed)) {
+			touch(info.fileName(), info.size());
+		}
+	}
+}
+
+QString
+TileCache::default_root()
+{
+	return QStandardPaths::writableLocation(QStandardPaths::GenericCacheLocation) + "/qGreyhound/tiles";
+}
+
+QString
+TileCache::tile_path(const pdal::Options& opts, const PDALConverter& converter) const
+{
+	const QString key = QString("%1|%2|%3|%4|%5|%6,%7,%8|%9")
+		.arg(QString::fromStdString(opts.getValueOrDefault<std::string>("url", "")))
+		.arg(QString::fromStdString(opts.getValueOrDefault<std::string>("bounds", "")))
+		.arg(QString::fromStdString(opts.getValueOrDefault<std::string>("depth_begin", "")))
+		.arg(QString::fromStdString(opts.getValueOrDefault<std::string>("depth_end", "")))
+		.arg(QString::fromStdString(opts.getValueOrDefault<std::string>("dims", "")))
+		.arg(converter.shift().x, 0, 'g', 17)
+		.arg(converter.shift().y, 0, 'g', 17)
+		.arg(converter.shift().z, 0, 'g', 17)
+		.arg(static_cast<int>(converter.color_depth()));
+	return m_dir.filePath(sha1_hex(key.toUtf8()) + ".tile");
+}
+
+bool
+TileCache::load(const pdal::Options& opts, const PDALConverter& converter, ccPointCloud *cloud, int *color_shift)
+{
+	QFile file(tile_path(opts, converter));
+	if (!cloud || !file.open(QIODevice::ReadWrite)) {
+		return false;
+	}
+
+	const auto file_size = static_cast<size_t>(file.size());
+	const uchar *data = file.map(0, file.size());
+	if (!data) {
+		return false;
+	}
+
+	const QString name = QFileInfo(file).fileName();
+	const auto invalid = [&file, &name, this]() {
+		ccLog::Warning(QString("[qGreyhound] Removing invalid cached tile %1").arg(file.fileName()));
+		file.close();
+		file.remove();
+		std::lock_guard<std::mutex> lk(m_mutex);
+		forget(name);
+		return false;
+	};
+
+	TileHeader header;
+	if (file_size < sizeof(header)) {
+		return invalid();
+	}
+	std::memcpy(&header, data, sizeof(header));
+	if (std::memcmp(header.magic, TileMagic, sizeof(TileMagic)) != 0 || header.version != TileVersion) {
+		return invalid();
+	}
+
+	const size_t count = header.point_count;
+	size_t offset = sizeof(header);
+
+	std::vector<std::pair<SfHeader, QByteArray>> sfs(header.sf_count);
+	for (auto& sf : sfs) {
+		if (offset + sizeof(SfHeader) > file_size) {
+			return invalid();
+		}
+		std::memcpy(&sf.first, data + offset, sizeof(SfHeader));
+		offset += sizeof(SfHeader);
+		if (offset + sf.first.name_size > file_size) {
+			return invalid();
+		}
+		sf.second = QByteArray(reinterpret_cast<const char*>(data + offset), sf.first.name_size);
+		offset += padded(sf.first.name_size);
+	}
+
+	const size_t points_offset = offset;
+	offset += header.has_xyz ? padded(count * 3 * sizeof(float)) : 0;
+	const size_t colors_offset = offset;
+	offset += header.has_colors ? padded(count * 3) : 0;
+	const size_t sf_offset = offset;
+	offset += header.sf_count * padded(count * sizeof(float));
+	if (offset > file_size) {
+		return invalid();
+	}
+
+	unsigned first_index = 0;
+	if (header.has_xyz) {
+		first_index = cloud->size();
+		if (!cloud->resize(first_index + static_cast<unsigned>(count))) {
+			return false;
+		}
+		const auto *xyz = reinterpret_cast<const float*>(data + points_offset);
+		for (size_t i = 0; i < count; ++i) {
+			*point_slot(cloud, static_cast<unsigned>(first_index + i)) = CCVector3(xyz[3 * i], xyz[3 * i + 1], xyz[3 * i + 2]);
+		}
+		cloud->setGlobalShift(-converter.shift());
+	}
+	else if (cloud->size() != count) {
+		return false;
+	}
+
+	if (header.has_colors) {
+		if (!cloud->hasColors() && !cloud->resizeTheRGBTable(false)) {
+			ccLog::Error("Failed to allocate memory for the colors.");
+		}
+		else {
+			const auto *rgb = reinterpret_cast<const ColorCompType*>(data + colors_offset);
+			for (size_t i = 0; i < count; ++i) {
+				cloud->setPointColor(static_cast<unsigned>(first_index + i), rgb + 3 * i);
+			}
+			cloud->showColors(true);
+		}
+	}
+
+	for (size_t k = 0; k < sfs.size(); ++k) {
+		auto sf = new ccScalarField(sfs[k].second.constData());
+		if (!sf->resize(static_cast<unsigned>(count))) {
+			sf->release();
+			continue;
+		}
+		const auto *values = reinterpret_cast<const float*>(data + sf_offset + k * padded(count * sizeof(float)));
+		for (size_t i = 0; i < count; ++i) {
+			sf->setValue(i, values[i]);
+		}
+		sf->setGlobalShift(sfs[k].first.global_shift);
+		sf->computeMinAndMax();
+
+		// Same display setup as PDALConverter
+		const int sf_index = cloud->addScalarField(sf);
+		if (sfs[k].second == "Intensity") {
+			sf->setColorScale(ccColorScalesManager::GetDefaultScale(ccColorScalesManager::GREY));
+			cloud->setCurrentDisplayedScalarField(sf_index);
+			cloud->showSF(true);
+		}
+	}
+
+	if (header.has_colors) {
+		converter.note_cached_color_shift(header.color_shift);
+	}
+	if (color_shift) {
+		*color_shift = header.color_shift;
+	}
+
+	// The modification time orders the index of the next session
+	file.setFileTime(QDateTime::currentDateTimeUtc(), QFileDevice::FileModificationTime);
+	std::lock_guard<std::mutex> lk(m_mutex);
+	touch(name, file.size());
+	return true;
+}
+
+void
+TileCache::store(const pdal::Options& opts, const PDALConverter& converter, const int color_shift, const ccPointCloud& cloud, const CloudMark& before)
+{
+	const bool has_xyz = cloud.size() > before.points;
+	const unsigned first_index = has_xyz ? before.points : 0;
+	const unsigned count = cloud.size() - first_index;
+	const bool has_colors = cloud.hasColors() && (has_xyz || !before.colors);
+	const unsigned sf_count = cloud.getNumberOfScalarFields() - before.scalar_fields;
+	if (count == 0 || (!has_xyz && !has_colors && sf_count == 0)) {
+		return;
+	}
+	write_tile(tile_path(opts, converter), cloud, first_index, count, has_xyz, has_colors, before.scalar_fields, color_shift);
+}
+
+void
+TileCache::store_range(const pdal::Options& opts, const PDALConverter& converter, const int color_shift, const ccPointCloud& cloud, const unsigned first_index, const unsigned count)
+{
+	if (count == 0) {
+		return;
+	}
+	write_tile(tile_path(opts, converter), cloud, first_index, count, true, cloud.hasColors(), 0, color_shift);
+}
+
+void
+TileCache::write_tile(const QString& path, const ccPointCloud& cloud, const unsigned first_index, const unsigned count, const bool has_xyz, const bool has_colors, const unsigned first_sf, const int color_shift)
+{
+	const unsigned sf_count = cloud.getNumberOfScalarFields() - first_sf;
+	QSaveFile file(path);
+	if (!file.open(QIODevice::WriteOnly)) {
+		return;
+	}
+
+	const char zeros[8]{};
+	const auto write_padding = [&file, &zeros](const size_t written) {
+		file.write(zeros, static_cast<qint64>(padded(written) - written));
+	};
+
+	TileHeader header{};
+	std::memcpy(header.magic, TileMagic, sizeof(TileMagic));
+	header.version = TileVersion;
+	header.point_count = count;
+	header.has_xyz = has_xyz;
+	header.has_colors = has_colors;
+	header.sf_count = sf_count;
+	header.color_shift = color_shift;
+	file.write(reinterpret_cast<const char*>(&header), sizeof(header));
+
+	for (unsigned k = first_sf; k < cloud.getNumberOfScalarFields(); ++k) {
+		const auto sf = static_cast<const ccScalarField*>(cloud.getScalarField(static_cast<int>(k)));
+		const QByteArray name(sf->getName());
+		SfHeader sf_header{};
+		sf_header.global_shift = sf->getGlobalShift();
+		sf_header.name_size = static_cast<uint32_t>(name.size());
+		file.write(reinterpret_cast<const char*>(&sf_header), sizeof(sf_header));
+		file.write(name);
+		write_padding(name.size());
+	}
+
+	if (has_xyz) {
+		std::vector<float> xyz(3 * ChunkSize);
+		for (size_t begin = 0; begin < count; begin += ChunkSize) {
+			const size_t end = std::min<size_t>(begin + ChunkSize, count);
+			for (size_t i = begin; i < end; ++i) {
+				CCVector3 p;
+				cloud.getPoint(static_cast<unsigned>(first_index + i), p);
+				xyz[3 * (i - begin)] = static_cast<float>(p.x);
+				xyz[3 * (i - begin) + 1] = static_cast<float>(p.y);
+				xyz[3 * (i - begin) + 2] = static_cast<float>(p.z);
+			}
+			file.write(reinterpret_cast<const char*>(xyz.data()), static_cast<qint64>(3 * (end - begin) * sizeof(float)));
+		}
+		write_padding(count * 3 * sizeof(float));
+	}
+
+	if (has_colors) {
+		std::vector<ColorCompType> rgb(3 * ChunkSize);
+		for (size_t begin = 0; begin < count; begin += ChunkSize) {
+			const size_t end = std::min<size_t>(begin + ChunkSize, count);
+			for (size_t i = begin; i < end; ++i) {
+				std::memcpy(&rgb[3 * (i - begin)], cloud.getPointColor(static_cast<unsigned>(first_index + i)), 3);
+			}
+			file.write(reinterpret_cast<const char*>(rgb.data()), static_cast<qint64>(3 * (end - begin)));
+		}
+		write_padding(count * 3);
+	}
+
+	std::vector<float> values(ChunkSize);
+	for (unsigned k = first_sf; k < cloud.getNumberOfScalarFields(); ++k) {
+		const auto sf = cloud.getScalarField(static_cast<int>(k));
+		for (size_t begin = 0; begin < count; begin += ChunkSize) {
+			const size_t end = std::min<size_t>(begin + ChunkSize, count);
+			for (size_t i = begin; i < end; ++i) {
+				values[i - begin] = sf->getValue(first_index + i);
+			}
+			file.write(reinterpret_cast<const char*>(values.data()), static_cast<qint64>((end - begin) * sizeof(float)));
+		}
+		write_padding(count * sizeof(float));
+	}
+
+	const qint64 size = file.pos();
+	const QString name = QFileInfo(path).fileName();
+	std::lock_guard<std::mutex> lk(m_mutex);
+	// A tile stored again replaces its file
+	forget(name);
+	evict(size);
+	if (file.commit()) {
+		touch(name, size);
+	}
+}
+
+void
+TileCache::evict(const qint64 incoming_bytes)
+{
+	while (m_size_bytes + incoming_bytes > m_max_bytes && !m_lru.empty()) {
+		const QString name = m_lru.front();
+		m_dir.remove(name);
+		forget(name);
+	}
+}
+
+void
+TileCache::touch(const QString& name, const qint64 bytes)
+{
+	forget(name);
+	m_lru.push_back(name);
+	m_index[name] = { bytes, std::prev(m_lru.end()) };
+	m_size_bytes += bytes;
+}
+
+void
+TileCache::forget(const QString& name)
+{
+	const auto entry = m_index.find(name);
+	if (entry == m_index.end()) {
+		return;
+	}
+	m_size_bytes -= entry->second.bytes;
+	m_lru.erase(entry->second.position);
+	m_index.erase(entry);
+}
+
+qint64
+TileCache::size_bytes() const
+{
+	std::lock_guard<std::mutex> lk(m_mutex);
+	return m_size_bytes;
+}
\ No newline at end of file
@@ -0,0 +1,74 @@
+#pragma once
+
+#include <list>
+#include <map>
+#include <mutex>
+
+#include <QDir>
+#include <QString>
+
+#include <pdal/pdal.hpp>
+
+#include <ccPointCloud.h>
+
+class PDALConverter;
+
+// What a cloud held before a tile was converted into it,
+// so only what the conversion added gets cached
+struct CloudMark
+{
+	explicit CloudMark(const ccPointCloud& cloud);
+
+	unsigned points;
+	unsigned scalar_fields;
+	bool colors;
+};
+
+// Persistent cache of converted tiles, one directory per resource.
+// Tiles are keyed by the request (url, bounds, depth range, dims) and the
+// converter's shift and color depth, and stored as raw column dumps that are
+// memory mapped back. The directory is emptied when the resource's /info
+// changes and the least recently used tiles are evicted past max_bytes,
+// from an index of the directory listed once and kept up to date.
+class TileCache
+{
+public:
+	static constexpr qint64 DefaultMaxBytes = qint64(2) << 30;
+
+	TileCache(const QString& resource_url, const QByteArray& info_digest, qint64 max_bytes = DefaultMaxBytes);
+
+	static QString default_root();
+
+	// color_shift is the shift the conversion wrote the colors with, which Auto
+	// tiles keep even if the depth settles otherwise later (see PDALConverter::recolor)
+	bool load(const pdal::Options& opts, const PDALConverter& converter, ccPointCloud *cloud, int *color_shift = nullptr);
+	void store(const pdal::Options& opts, const PDALConverter& converter, int color_shift, const ccPointCloud& cloud, const CloudMark& before);
+	// Stores the points [first_index, first_index + count) with all their colors and scalar fields
+	void store_range(const pdal::Options& opts, const PDALConverter& converter, int color_shift, const ccPointCloud& cloud, unsigned first_index, unsigned count);
+
+	qint64 size_bytes() const;
+
+private:
+	QString tile_path(const pdal::Options& opts, const PDALConverter& converter) const;
+	void write_tile(const QString& path, const ccPointCloud& cloud, unsigned first_index, unsigned count, bool has_xyz, bool has_colors, unsigned first_sf, int color_shift);
+	// These expect m_mutex to be held
+	void evict(qint64 incoming_bytes);
+	void touch(const QString& name, qint64 bytes);
+	void forget(const QString& name);
+
+private:
+	struct IndexEntry
+	{
+		qint64 bytes;
+		std::list<QString>::iterator position;
+	};
+
+	QDir m_dir;
+	qint64 m_max_bytes;
+	// Of the tiles in the index
+	qint64 m_size_bytes;
+	// Tile file names, least recently used first
+	std::list<QString> m_lru;
+	std::map<QString, IndexEntry> m_index;
+	mutable std::mutex m_mutex;
+};
\ No newline at end of file
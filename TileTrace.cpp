@@ -0,0 +1,142 @@
+#include <algorithm>
+
+#include <QFile>
+#include <QJsonArray>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <ccLog.h>
+
+#include "TileTrace.h"
+
+constexpr size_t TileTrace::MaxEvents;
+
+namespace {
+
+// Small stable ids read better than std::thread::id in trace viewers
+int
+thread_number()
+{
+	static std::atomic<int> next(0);
+	thread_local const int number = next++;
+	return number;
+}
+
+}
+
+TileTrace::TileTrace()
+	: m_origin(Clock::now())
+	, m_dropped(0)
+{
+}
+
+void
+TileTrace::record(const char *phase, const Clock::time_point start, const Clock::time_point end, const TraceTile& tile)
+{
+	const double start_us = std::chrono::duration<double, std::micro>(start - m_origin).count();
+	const double duration_us = std::chrono::duration<double, std::micro>(end - start).count();
+	const int thread = thread_number();
+
+	std::lock_guard<std::mutex> lk(m_mutex);
+	PhaseTotal& total = m_totals.emplace(phase, PhaseTotal{ 0, 0, 0 }).first->second;
+	total.count++;
+	total.total_us += duration_us;
+	total.max_us = std::max(total.max_us, duration_us);
+
+	if (m_events.size() < MaxEvents) {
+		m_events.push_back({ phase, thread, start_us, duration_us, tile });
+	}
+	else {
+		m_dropped++;
+	}
+}
+
+QString
+TileTrace::summary() const
+{
+	std::lock_guard<std::mutex> lk(m_mutex);
+	QString text("[qGreyhound] trace:");
+	for (const auto& phase : m_totals) {
+		const PhaseTotal& t = phase.second;
+		text += QString(" %1 %2x total %3 ms mean %4 ms max %5 ms;")
+			.arg(QString::fromStdString(phase.first))
+			.arg(t.count)
+			.arg(t.total_us / 1000, 0, 'f', 1)
+			.arg(t.count ? t.total_us / 1000 / t.count : 0.0, 0, 'f', 2)
+			.arg(t.max_us / 1000, 0, 'f', 1);
+	}
+	if (m_dropped) {
+		text += QString(" %1 events not kept in the trace").arg(m_dropped);
+	}
+	return text;
+}
+
+bool
+TileTrace::write_chrome_trace(const QString& path) const
+{
+	QJsonArray events;
+	{
+		std::lock_guard<std::mutex> lk(m_mutex);
+		for (const Event& e : m_events) {
+			QJsonObject args;
+			if (e.tile.depth >= 0) {
+				args["depth"] = e.tile.depth;
+				args["bounds"] = QJsonArray{ e.tile.bounds[0], e.tile.bounds[1], e.tile.bounds[2], e.tile.bounds[3], e.tile.bounds[4], e.tile.bounds[5] };
+			}
+			args["bytes"] = static_cast<double>(e.tile.bytes);
+			args["points"] = static_cast<double>(e.tile.points);
+
+			QJsonObject event;
+			event["name"] = e.phase;
+			event["cat"] = "qGreyhound";
+			event["ph"] = "X";
+			event["pid"] = 1;
+			event["tid"] = e.thread;
+			event["ts"] = e.start_us;
+			event["dur"] = e.duration_us;
+			event["args"] = args;
+			events.append(event);
+		}
+	}
+
+	QJsonObject trace;
+	trace["traceEvents"] = events;
+	trace["displayTimeUnit"] = "ms";
+
+	QFile file(path);
+	if (!file.open(QIODevice::WriteOnly | QIODevice::Truncate)) {
+		return false;
+	}
+	return file.write(QJsonDocument(trace).toJson(QJsonDocument::Compact)) >= 0;
+}
+
+void
+TileTrace::publish() const
+{
+	const QString path = QString::fromLocal8Bit(qgetenv("QGREYHOUND_TRACE"));
+	if (path.isEmpty()) {
+		return;
+	}
+	ccLog::Print(summary());
+	if (write_chrome_trace(path)) {
+		ccLog::Print(QString("[qGreyhound] trace written to %1").arg(path));
+	}
+	else {
+		ccLog::Warning(QString("[qGreyhound] could not write the trace to %1").arg(path));
+	}
+}
+
+TracePhase::TracePhase(TileTrace *trace, const char *phase, const TraceTile& tile)
+	: tile(tile)
+	, m_trace(trace)
+	, m_phase(phase)
+	, m_start(trace ? TileTrace::Clock::now() : TileTrace::Clock::time_point())
+{
+}
+
+TracePhase::~TracePhase()
+{
+	if (m_trace) {
+		m_trace->record(m_phase, m_start, TileTrace::Clock::now(), tile);
+	}
+}
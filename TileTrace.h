@@ -0,0 +1,92 @@
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <map>
+#include <mutex>
+#include <string>
+#include <vector>
+
+#include <QString>
+
+// What a traced phase worked on
+struct TraceTile
+{
+	TraceTile()
+		: bounds{}
+		, depth(-1)
+		, bytes(0)
+		, points(0)
+	{}
+
+	double bounds[6];
+	int depth;
+	size_t bytes;
+	size_t points;
+};
+
+// Durations of the phases tiles go through during a download.
+// Meant to stay on: a phase costs two clock reads and a short lock,
+// and past MaxEvents only the per phase totals keep growing.
+class TileTrace
+{
+public:
+	using Clock = std::chrono::steady_clock;
+
+	static constexpr size_t MaxEvents = 1 << 20;
+
+	TileTrace();
+
+	// phase must outlive the trace, a string literal
+	void record(const char *phase, Clock::time_point start, Clock::time_point end, const TraceTile& tile);
+
+	// Count, total, mean and max duration of each phase
+	QString summary() const;
+	// Chrome trace event format, opens in chrome://tracing and Perfetto
+	bool write_chrome_trace(const QString& path) const;
+	// When the QGREYHOUND_TRACE environment variable names a file,
+	// logs the summary and writes the trace there
+	void publish() const;
+
+private:
+	struct Event
+	{
+		const char *phase;
+		int thread;
+		double start_us;
+		double duration_us;
+		TraceTile tile;
+	};
+
+	struct PhaseTotal
+	{
+		size_t count;
+		double total_us;
+		double max_us;
+	};
+
+	Clock::time_point m_origin;
+	mutable std::mutex m_mutex;
+	std::vector<Event> m_events;
+	size_t m_dropped;
+	std::map<std::string, PhaseTotal> m_totals;
+};
+
+// Records the time between its construction and destruction, fill tile as
+// the phase learns about it. Does nothing without a trace.
+class TracePhase
+{
+public:
+	TracePhase(TileTrace *trace, const char *phase, const TraceTile& tile = TraceTile());
+	~TracePhase();
+
+	TracePhase(const TracePhase&) = delete;
+	TracePhase& operator=(const TracePhase&) = delete;
+
+	TraceTile tile;
+
+private:
+	TileTrace *m_trace;
+	const char *m_phase;
+	TileTrace::Clock::time_point m_start;
+};
@@ -0,0 +1,237 @@
+#include <QtConcurrent>
+
+#include <ccGLWindow.h>
+#include <ccMainAppInterface.h>
+
+#include "GreyhoundDownloader.h"
+#include "ViewStream.h"
+
+ViewStream::ViewStream(ccMainAppInterface *app, ccGLWindow *window, ccHObject *group, StreamingPlanner planner,
+	pdal::Options opts, std::vector<GreyhoundDimension> schema, PDALConverter converter, std::shared_ptr<TileCache> cache)
+	: m_app(app)
+	, m_window(window)
+	, m_group(group)
+	, m_watcher([this](const ccHObject *object) { deleted(object); })
+	, m_planner(std::move(planner))
+	, m_opts(std::move(opts))
+	, m_converter(std::move(converter))
+	, m_cache(std::move(cache))
+	, m_read(std::make_shared<const GreyhoundRead>(m_opts.getValueOrThrow<std::string>("url"), std::move(schema), dimension_names(m_opts)))
+	, m_cancel(std::make_shared<CancelToken>())
+{
+	m_watcher.watch(m_group);
+	// The pool converts a tile per thread
+	m_converter.set_parallel(false);
+	m_pool.setMaxThreadCount(std::max(QThread::idealThreadCount(), 2));
+	m_timer.setInterval(ReplanIntervalMs);
+	QObject::connect(&m_timer, &QTimer::timeout, [this]() { replan(); });
+}
+
+ViewStream::~ViewStream()
+{
+	stop();
+	m_cancel->cancel();
+	m_pool.waitForDone();
+	for (auto& request : m_in_flight) {
+		delete request.second.watcher->result();
+		delete request.second.watcher;
+	}
+	for (auto& tile : m_loaded) {
+		m_watcher.unwatch(tile.second);
+	}
+	if (m_group) {
+		m_watcher.unwatch(m_group);
+	}
+}
+
+void
+ViewStream::start()
+{
+	if (!m_group) {
+		return;
+	}
+	m_last_camera.clear();
+	m_timer.start();
+	replan();
+}
+
+void
+ViewStream::stop()
+{
+	m_timer.stop();
+	m_wanted.clear();
+	m_wanted_keys.clear();
+	for (auto& request : m_in_flight) {
+		*request.second.wanted = false;
+	}
+}
+
+void
+ViewStream::replan()
+{
+	if (!m_window) {
+		stop();
+		return;
+	}
+	ccGLCameraParameters camera;
+	m_window->getGLCameraParameters(camera);
+
+	std::vector<double> current(camera.modelViewMat.data(), camera.modelViewMat.data() + 16);
+	current.insert(current.end(), camera.projectionMat.data(), camera.projectionMat.data() + 16);
+	current.push_back(camera.viewport[3]);
+	if (current == m_last_camera) {
+		return;
+	}
+	m_last_camera = current;
+
+	const ViewState view = make_view_state(camera.modelViewMat.data(), camera.projectionMat.data(), camera.viewport[3], camera.perspective);
+	const auto is_empty = [this](const TileKey& key) { return m_empty.count(key) != 0; };
+	m_wanted = m_planner.plan(view, MaxScreenError, MaxPlannedTiles, is_empty);
+	m_wanted_keys.clear();
+	for (const auto& tile : m_wanted) {
+		m_wanted_keys.insert(tile.key);
+	}
+
+	// Drop the detail the view no longer needs, the root stays as an overview
+	bool removed = false;
+	for (auto it = m_loaded.begin(); it != m_loaded.end();) {
+		if (m_wanted_keys.count(it->first) || it->first == m_planner.root_key()) {
+			++it;
+			continue;
+		}
+		// Not a deletion the watcher has to report
+		m_watcher.unwatch(it->second);
+		m_app->removeFromDB(it->second);
+		it = m_loaded.erase(it);
+		removed = true;
+	}
+	// Requests that did not start yet are skipped by the pool
+	for (auto& request : m_in_flight) {
+		*request.second.wanted = m_wanted_keys.count(request.first) != 0;
+	}
+
+	request_missing();
+	if (removed) {
+		m_app->refreshAll();
+	}
+}
+
+void
+ViewStream::request_missing()
+{
+	for (const auto& tile : m_wanted) {
+		const auto in_flight = m_in_flight.find(tile.key);
+		if (in_flight != m_in_flight.end()) {
+			*in_flight->second.wanted = true;
+			continue;
+		}
+		if (m_loaded.count(tile.key) || m_empty.count(tile.key)) {
+			continue;
+		}
+
+		pdal::Options opts(m_opts);
+		opts.add("depth_begin", tile.key.depth);
+		opts.add("depth_end", tile.key.depth + 1);
+		opts.add("bounds", tile.b.toJson());
+
+		const PDALConverter converter(m_converter);
+		TileCache *cache = m_cache.get();
+		const auto read = m_read;
+		const auto cancel = m_cancel;
+		const auto b = tile.b;
+		auto wanted = std::make_shared<std::atomic<bool>>(true);
+		// Set by the worker before the future finishes
+		auto color_shift = std::make_shared<int>(0);
+		auto watcher = new QFutureWatcher<ccPointCloud*>();
+		const TileKey key = tile.key;
+		QObject::connect(watcher, &QFutureWatcher<ccPointCloud*>::finished, &m_timer, [this, key, watcher, color_shift]() {
+			m_in_flight.erase(key);
+			ccPointCloud *cloud = watcher->result();
+			watcher->deleteLater();
+			tile_arrived(key, cloud, *color_shift);
+		});
+		watcher->setFuture(QtConcurrent::run(&m_pool, [read, opts, b, key, converter, cache, wanted, cancel, color_shift]() -> ccPointCloud* {
+			if (!*wanted || cancel->cancelled()) {
+				return nullptr;
+			}
+			auto cloud = new ccPointCloud("tile");
+			try {
+				*color_shift = download_and_convert_tile(cloud, *read, opts, b, key.depth, key.depth + 1, converter, cache, cancel.get());
+			}
+			catch (const DownloadCancelled&) {
+				delete cloud;
+				return nullptr;
+			}
+			catch (const std::exception& e) {
+				ccLog::Print(QString("[qGreyhound] %1").arg(e.what()));
+				delete cloud;
+				return nullptr;
+			}
+			return cloud;
+		}));
+		m_in_flight[key] = { watcher, wanted };
+	}
+}
+
+void
+ViewStream::tile_arrived(const TileKey& key, ccPointCloud *tile, const int color_shift)
+{
+	if (!tile) {
+		return;
+	}
+	if (tile->size() == 0) {
+		// Nothing below it either
+		m_empty.insert(key);
+		delete tile;
+		return;
+	}
+	if (!m_group || !m_wanted_keys.count(key) || m_loaded.count(key)) {
+		delete tile;
+		return;
+	}
+
+	tile->setName(QString("depth %1 (%2, %3, %4)").arg(key.depth).arg(key.x).arg(key.y).arg(key.z));
+	m_group->addChild(tile);
+	m_app->addToDB(tile, false, false, false, true);
+	m_loaded[key] = tile;
+	m_watcher.watch(tile);
+
+	// Tiles converted before an Auto color depth settled are narrowed once it does
+	const int settled = m_converter.effective_color_shift();
+	if (settled < 0) {
+		m_provisional[key] = color_shift;
+		return;
+	}
+	PDALConverter::recolor(tile, 0, tile->size(), color_shift, settled);
+	bool recolored = false;
+	for (const auto& provisional : m_provisional) {
+		const auto loaded = m_loaded.find(provisional.first);
+		if (loaded != m_loaded.end() && provisional.second < settled) {
+			PDALConverter::recolor(loaded->second, 0, loaded->second->size(), provisional.second, settled);
+			loaded->second->prepareDisplayForRefresh();
+			recolored = true;
+		}
+	}
+	m_provisional.clear();
+	if (recolored) {
+		m_app->refreshAll();
+	}
+}
+
+void
+ViewStream::deleted(const ccHObject *object)
+{
+	if (object == m_group) {
+		// Its tiles go with it
+		m_group = nullptr;
+		m_loaded.clear();
+		stop();
+		return;
+	}
+	for (auto it = m_loaded.begin(); it != m_loaded.end(); ++it) {
+		if (it->second == object) {
+			m_loaded.erase(it);
+			return;
+		}
+	}
+}
@@ -0,0 +1,84 @@
+#pragma once
+
+#include <atomic>
+#include <map>
+#include <memory>
+#include <set>
+
+#include <QFutureWatcher>
+#include <QPointer>
+#include <QThreadPool>
+#include <QTimer>
+
+#include <ccPointCloud.h>
+
+#include "CancelToken.h"
+#include "DeletionWatcher.h"
+#include "GreyhoundRead.h"
+#include "PDALConverter.h"
+#include "StreamingPlanner.h"
+#include "TileCache.h"
+
+class ccGLWindow;
+class ccMainAppInterface;
+
+// Keeps the tiles of a resource that the 3D view needs loaded,
+// one cloud per tile under a group, re-planning when the camera moves
+class ViewStream
+{
+public:
+	static constexpr int ReplanIntervalMs = 250;
+	// Tiles are refined until the gap between their points is below this on screen
+	static constexpr double MaxScreenError = 4.0;
+	static constexpr size_t MaxPlannedTiles = 1024;
+
+	// group must be in the DB, the tiles are added under it. schema is the resource's.
+	// Streaming stops if the user deletes it.
+	ViewStream(ccMainAppInterface *app, ccGLWindow *window, ccHObject *group, StreamingPlanner planner,
+		pdal::Options opts, std::vector<GreyhoundDimension> schema, PDALConverter converter, std::shared_ptr<TileCache> cache);
+	~ViewStream();
+
+	void start();
+	// Stops planning and requesting, the tiles loaded so far stay
+	void stop();
+
+private:
+	void replan();
+	void request_missing();
+	void tile_arrived(const TileKey& key, ccPointCloud *tile, int color_shift);
+	void deleted(const ccHObject *object);
+
+	ccMainAppInterface *m_app;
+	// Null once the user closed the view, streaming then stops
+	QPointer<ccGLWindow> m_window;
+	// Null once deleted, the group and the loaded tiles are watched
+	ccHObject *m_group;
+	DeletionWatcher m_watcher;
+	StreamingPlanner m_planner;
+	pdal::Options m_opts;
+	PDALConverter m_converter;
+	std::shared_ptr<TileCache> m_cache;
+	std::shared_ptr<const GreyhoundRead> m_read;
+	// Aborts the requests running when the stream is destroyed
+	std::shared_ptr<CancelToken> m_cancel;
+
+	QTimer m_timer;
+	QThreadPool m_pool;
+	std::vector<double> m_last_camera;
+
+	// Most important first
+	std::vector<PlannedTile> m_wanted;
+	std::set<TileKey> m_wanted_keys;
+	std::map<TileKey, ccPointCloud*> m_loaded;
+	// The color shift of the tiles loaded while the color depth was not settled
+	std::map<TileKey, int> m_provisional;
+	std::set<TileKey> m_empty;
+
+	struct Request
+	{
+		QFutureWatcher<ccPointCloud*> *watcher;
+		// Cleared when the view moved away before the request started
+		std::shared_ptr<std::atomic<bool>> wanted;
+	};
+	std::map<TileKey, Request> m_in_flight;
+};
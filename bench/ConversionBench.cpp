@@ -0,0 +1,192 @@
+// Times PDALConverter::convert on a pdal::PointView laid out like a greyhound
+// read: doubles for X, Y, Z and GpsTime, 16 bit Intensity and colors and an
+// 8 bit Classification. The reference is the per point conversion the plugin
+// had before the columnar one, one getFieldAs call per point and dimension.
+//
+// The columnar conversion runs on every instruction set the cpu supports,
+// once on the global pool and once on a single thread, the way the download
+// converters run. Prints one line of json per path with the best of the repeats.
+//
+//   qgreyhound_conversion_bench [--points n] [--repeats n]
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdio>
+#include <functional>
+#include <memory>
+#include <new>
+#include <random>
+
+#include <ccPointCloud.h>
+#include <ccScalarField.h>
+
+#include "ConversionKernels.h"
+#include "PDALConverter.h"
+
+using DimId = pdal::Dimension::Id;
+
+namespace {
+
+pdal::PointViewPtr
+make_view(pdal::PointTable& table, const size_t points)
+{
+	const auto layout = table.layout();
+	layout->registerDim(DimId::X, pdal::Dimension::Type::Double);
+	layout->registerDim(DimId::Y, pdal::Dimension::Type::Double);
+	layout->registerDim(DimId::Z, pdal::Dimension::Type::Double);
+	layout->registerDim(DimId::Intensity, pdal::Dimension::Type::Unsigned16);
+	layout->registerDim(DimId::Red, pdal::Dimension::Type::Unsigned16);
+	layout->registerDim(DimId::Green, pdal::Dimension::Type::Unsigned16);
+	layout->registerDim(DimId::Blue, pdal::Dimension::Type::Unsigned16);
+	layout->registerDim(DimId::GpsTime, pdal::Dimension::Type::Double);
+	layout->registerDim(DimId::Classification, pdal::Dimension::Type::Unsigned8);
+	table.finalize();
+
+	std::mt19937_64 rng(42);
+	std::uniform_real_distribution<double> coordinate(0, 1024);
+	std::uniform_int_distribution<int> channel(0, 0xFFFF);
+	std::uniform_int_distribution<int> classification(0, 31);
+	auto view = std::make_shared<pdal::PointView>(table);
+	for (pdal::PointId i = 0; i < points; ++i) {
+		view->setField(DimId::X, i, 1415000 + coordinate(rng));
+		view->setField(DimId::Y, i, 4184000 + coordinate(rng));
+		view->setField(DimId::Z, i, coordinate(rng) / 8);
+		view->setField(DimId::Intensity, i, static_cast<uint16_t>(channel(rng)));
+		view->setField(DimId::Red, i, static_cast<uint16_t>(channel(rng)));
+		view->setField(DimId::Green, i, static_cast<uint16_t>(channel(rng)));
+		view->setField(DimId::Blue, i, static_cast<uint16_t>(channel(rng)));
+		view->setField(DimId::GpsTime, i, 3.2e8 + 1e-5 * i);
+		view->setField(DimId::Classification, i, static_cast<uint8_t>(classification(rng)));
+	}
+	return view;
+}
+
+// The conversion the plugin had before the columnar one
+void
+convert_per_point(const pdal::PointViewPtr view, const pdal::PointLayoutPtr layout, const CCVector3d& shift, ccPointCloud *cloud)
+{
+	if (!cloud->reserve(static_cast<unsigned>(view->size()))) {
+		throw std::bad_alloc();
+	}
+	for (pdal::PointId i = 0; i < view->size(); ++i) {
+		cloud->addPoint(CCVector3(
+			static_cast<PointCoordinateType>(view->getFieldAs<double>(DimId::X, i) - shift.x),
+			static_cast<PointCoordinateType>(view->getFieldAs<double>(DimId::Y, i) - shift.y),
+			static_cast<PointCoordinateType>(view->getFieldAs<double>(DimId::Z, i) - shift.z)
+		));
+	}
+	cloud->setGlobalShift(-shift);
+
+	if (!cloud->reserveTheRGBTable()) {
+		throw std::bad_alloc();
+	}
+	std::array<ColorCompType, 3> rgb{ 0, 0, 0 };
+	for (pdal::PointId i = 0; i < view->size(); ++i) {
+		rgb[0] = static_cast<ColorCompType>(view->getFieldAs<uint16_t>(DimId::Red, i) >> 8);
+		rgb[1] = static_cast<ColorCompType>(view->getFieldAs<uint16_t>(DimId::Green, i) >> 8);
+		rgb[2] = static_cast<ColorCompType>(view->getFieldAs<uint16_t>(DimId::Blue, i) >> 8);
+		cloud->addRGBColor(rgb.data());
+	}
+
+	for (auto id : layout->dims()) {
+		if (id == DimId::X || id == DimId::Y || id == DimId::Z
+			|| id == DimId::Red || id == DimId::Green || id == DimId::Blue) {
+			continue;
+		}
+		auto sf = new ccScalarField(layout->dimName(id).c_str());
+		sf->reserve(static_cast<unsigned>(view->size()));
+		for (pdal::PointId i = 0; i < view->size(); ++i) {
+			sf->addElement(view->getFieldAs<ScalarType>(id, i));
+		}
+		sf->computeMinAndMax();
+		cloud->addScalarField(sf);
+	}
+}
+
+// Best time of repeats, each converting into a new cloud
+double
+best_seconds(const int repeats, const std::function<void(ccPointCloud*)>& convert)
+{
+	double best = -1;
+	for (int r = 0; r < repeats; ++r) {
+		std::unique_ptr<ccPointCloud> cloud(new ccPointCloud("bench"));
+		const auto start = std::chrono::steady_clock::now();
+		convert(cloud.get());
+		const double seconds = std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+		if (best < 0 || seconds < best) {
+			best = seconds;
+		}
+	}
+	return best;
+}
+
+void
+report(const char *path, const Kernels::Isa isa, const size_t points, const double seconds, const double baseline)
+{
+	QJsonObject line;
+	line["path"] = path;
+	line["isa"] = Kernels::isa_name(isa);
+	line["points"] = static_cast<double>(points);
+	line["seconds"] = seconds;
+	line["points_per_s"] = points / seconds;
+	line["speedup"] = baseline / seconds;
+	std::printf("%s\n", QJsonDocument(line).toJson(QJsonDocument::Compact).constData());
+}
+
+}
+
+int
+main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Times PDALConverter::convert against the per point conversion");
+	parser.addHelpOption();
+	const QCommandLineOption points_option("points", "Points of the view.", "points", "2000000");
+	const QCommandLineOption repeats_option("repeats", "Conversions per path, the best one is kept.", "repeats", "5");
+	parser.addOptions({ points_option, repeats_option });
+	parser.process(app);
+
+	const size_t points = parser.value(points_option).toULongLong();
+	const int repeats = std::max(parser.value(repeats_option).toInt(), 1);
+
+	try {
+		pdal::PointTable table;
+		const pdal::PointViewPtr view = make_view(table, points);
+		const CCVector3d shift(1415000, 4184000, 0);
+
+		const double per_point = best_seconds(repeats, [&](ccPointCloud *cloud) {
+			convert_per_point(view, table.layout(), shift, cloud);
+		});
+		report("per_point", Kernels::Isa::Scalar, points, per_point, per_point);
+
+		for (Kernels::Isa isa : { Kernels::Isa::Scalar, Kernels::Isa::Avx2, Kernels::Isa::Avx512 }) {
+			if (static_cast<int>(isa) > static_cast<int>(Kernels::detected_isa())) {
+				break;
+			}
+			Kernels::set_active_isa(isa);
+			for (bool parallel : { true, false }) {
+				PDALConverter converter;
+				converter.set_shift(shift);
+				converter.set_color_depth(PDALConverter::ColorDepth::Bits16);
+				converter.set_parallel(parallel);
+				const double columns = best_seconds(repeats, [&](ccPointCloud *cloud) {
+					converter.convert(view, table.layout(), cloud);
+				});
+				report(parallel ? "columns_parallel" : "columns", isa, points, columns, per_point);
+			}
+		}
+	}
+	catch (const std::exception& e) {
+		std::fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+	return 0;
+}
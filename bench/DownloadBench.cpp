@@ -0,0 +1,293 @@
+// Downloads the mock resource served by a local MockServer the way qGreyhound
+// does: the first depths in one request, then the deeper ones with
+// GreyhoundDownloader. Prints one line of json per scenario with the
+// download stats (points/s, bytes/s, time to first points, peak rss), the
+// scenario and what the server answered.
+//
+//   qgreyhound_download_bench [options]        runs one scenario
+//   qgreyhound_download_bench --all [options]  runs every scenario, each in a process
+//                                              of its own so that peak rss is its own,
+//                                              then compares octree and quadtree
+//   qgreyhound_download_bench --compare-octree [options]
+//                                              only compares octree and quadtree
+//
+// The server runs in the same process, peak rss includes its response buffers.
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+#include <QJsonDocument>
+#include <QJsonObject>
+#include <QProcess>
+
+#include <chrono>
+#include <cstdio>
+#include <map>
+
+#include <ccPointCloud.h>
+
+#include "GreyhoundDownloader.h"
+#include "GreyhoundRead.h"
+#include "PDALConverter.h"
+#include "MockServer.h"
+
+using DownloadMethod = GreyhoundDownloader::DownloadMethod;
+
+namespace {
+
+const std::map<QString, DownloadMethod> Methods{
+	{ "depth_by_depth", DownloadMethod::DepthByDepth },
+	{ "quadtree", DownloadMethod::Quadtree },
+	{ "octree", DownloadMethod::Octree }
+};
+
+struct Scenario
+{
+	QString method;
+	// Converter threads, 0 for one per core
+	int threads;
+	// Side of the downloaded box over the side of the resource, centered on it
+	double bbox;
+};
+
+struct Settings
+{
+	int depths;
+	int start_depth;
+	LinkShape shape;
+	// Reads are laz-perf compressed unless PDAL lacks it or this is off
+	bool compressed;
+};
+
+std::vector<Scenario>
+all_scenarios()
+{
+	std::vector<Scenario> scenarios;
+	for (const auto& method : Methods) {
+		for (int threads : { 1, 2, 4, 0 }) {
+			scenarios.push_back({ method.first, threads, 1.0 });
+		}
+		for (double bbox : { 0.25, 0.5 }) {
+			scenarios.push_back({ method.first, 0, bbox });
+		}
+	}
+	return scenarios;
+}
+
+double
+seconds_since(const std::chrono::steady_clock::time_point start)
+{
+	return std::chrono::duration<double>(std::chrono::steady_clock::now() - start).count();
+}
+
+int
+run_scenario(const Scenario& scenario, const Settings& settings)
+{
+	const auto resource = std::make_shared<const MockResource>(settings.depths);
+	MockServerThread server(resource, settings.shape);
+	if (!server.start_listening()) {
+		std::fprintf(stderr, "the mock server could not listen\n");
+		return 1;
+	}
+	const std::string url = server.url().toStdString();
+
+	// Over the whole height of the resource, as qGreyhound asks for octree downloads
+	const MockBounds full = resource->bounds();
+	const double half = scenario.bbox * (full.max[0] - full.min[0]) / 2;
+	const double cx = (full.min[0] + full.max[0]) / 2;
+	const double cy = (full.min[1] + full.max[1]) / 2;
+	const pdal::greyhound::Bounds bounds(cx - half, cy - half, full.min[2], cx + half, cy + half, full.max[2]);
+
+	Json::Value dims(Json::arrayValue);
+	for (const char *name : { "Intensity", "Red", "Green", "Blue", "Classification", "GpsTime" }) {
+		dims.append(name);
+	}
+	pdal::Options opts;
+	opts.add("url", url);
+	opts.add("dims", dims);
+	Json::FastWriter writer;
+	const GreyhoundInfo info(QJsonDocument::fromJson(QByteArray::fromStdString(writer.write(resource->info()))).object());
+
+	const auto start = std::chrono::steady_clock::now();
+	ccPointCloud cloud;
+	PDALConverter converter;
+	{
+		GreyhoundRead read(url, info.schema(), dims);
+		read.set_compressed(settings.compressed);
+		pdal::PointTable table;
+		const pdal::PointViewPtr view = read.decode(read.fetch(bounds, 0, settings.start_depth + 1), table);
+		converter.convert(view, table.layout(), &cloud);
+	}
+	const double first_depths_seconds = seconds_since(start);
+
+	GreyhoundDownloader downloader(opts, info.schema(), static_cast<uint32_t>(settings.start_depth + 1), bounds, converter);
+	downloader.set_compressed(settings.compressed);
+	downloader.set_converter_threads(static_cast<size_t>(scenario.threads));
+	downloader.download_to(&cloud, Methods.at(scenario.method));
+
+	QJsonObject report = downloader.stats().to_json();
+	report["method"] = scenario.method;
+	report["threads"] = scenario.threads;
+	report["bbox"] = scenario.bbox;
+	report["depths"] = settings.depths;
+	report["start_depth"] = settings.start_depth;
+	report["latency_ms"] = settings.shape.latency_ms;
+	report["bandwidth_bytes_per_second"] = settings.shape.bytes_per_second;
+	report["first_depths_seconds"] = first_depths_seconds;
+	report["total_seconds"] = seconds_since(start);
+	report["cloud_points"] = static_cast<double>(cloud.size());
+	report["server"] = server.counters().to_json();
+	std::printf("%s\n", QJsonDocument(report).toJson(QJsonDocument::Compact).constData());
+	std::fflush(stdout);
+	return 0;
+}
+
+// Runs a scenario in a child process and forwards its report, empty if it failed
+QJsonObject
+run_child(const Scenario& scenario, const QStringList& shared_args)
+{
+	QStringList args(shared_args);
+	args << "--method" << scenario.method
+		<< "--threads" << QString::number(scenario.threads)
+		<< "--bbox" << QString::number(scenario.bbox);
+
+	QProcess child;
+	child.setProcessChannelMode(QProcess::ForwardedErrorChannel);
+	child.start(QCoreApplication::applicationFilePath(), args);
+	if (!child.waitForFinished(-1) || child.exitStatus() != QProcess::NormalExit || child.exitCode() != 0) {
+		std::fprintf(stderr, "scenario %s failed: %s\n", qPrintable(args.join(" ")), qPrintable(child.errorString()));
+		return QJsonObject();
+	}
+	const QByteArray report = child.readAllStandardOutput();
+	std::printf("%s", report.constData());
+	std::fflush(stdout);
+	return QJsonDocument::fromJson(report).object();
+}
+
+// What hierarchy driven octree refinement gains over quadtree columns
+// on the same box, printed as one more line of json
+void
+compare_octree(const QJsonObject& quadtree, const QJsonObject& octree)
+{
+	const auto server = [](const QJsonObject& report, const char *key) {
+		return report["server"].toObject()[key].toDouble();
+	};
+	const double quadtree_seconds = quadtree["wall_seconds"].toDouble();
+	const double octree_seconds = octree["wall_seconds"].toDouble();
+
+	QJsonObject comparison;
+	comparison["comparison"] = "octree_vs_quadtree";
+	comparison["bbox"] = octree["bbox"];
+	comparison["quadtree_seconds"] = quadtree_seconds;
+	comparison["octree_seconds"] = octree_seconds;
+	comparison["speedup"] = octree_seconds > 0 ? quadtree_seconds / octree_seconds : 0.0;
+	comparison["quadtree_points"] = quadtree["points"];
+	comparison["octree_points"] = octree["points"];
+	comparison["quadtree_reads"] = server(quadtree, "reads");
+	comparison["octree_reads"] = server(octree, "reads");
+	comparison["quadtree_empty_reads"] = server(quadtree, "empty_reads");
+	comparison["octree_empty_reads"] = server(octree, "empty_reads");
+	comparison["quadtree_bytes"] = quadtree["bytes"];
+	comparison["octree_bytes"] = octree["bytes"];
+	std::printf("%s\n", QJsonDocument(comparison).toJson(QJsonDocument::Compact).constData());
+	std::fflush(stdout);
+}
+
+int
+run_all(const QStringList& shared_args)
+{
+	int failures = 0;
+	std::map<double, QJsonObject> quadtree;
+	std::map<double, QJsonObject> octree;
+	for (const auto& scenario : all_scenarios()) {
+		const QJsonObject report = run_child(scenario, shared_args);
+		if (report.isEmpty()) {
+			++failures;
+			continue;
+		}
+		// Compared with the threads both get by default
+		if (scenario.threads == 0 && scenario.method == "quadtree") {
+			quadtree[scenario.bbox] = report;
+		}
+		if (scenario.threads == 0 && scenario.method == "octree") {
+			octree[scenario.bbox] = report;
+		}
+	}
+	for (const auto& q : quadtree) {
+		if (octree.count(q.first)) {
+			compare_octree(q.second, octree[q.first]);
+		}
+	}
+	return failures ? 1 : 0;
+}
+
+int
+run_comparison(const Scenario& scenario, const QStringList& shared_args)
+{
+	const QJsonObject quadtree = run_child({ "quadtree", scenario.threads, scenario.bbox }, shared_args);
+	const QJsonObject octree = run_child({ "octree", scenario.threads, scenario.bbox }, shared_args);
+	if (quadtree.isEmpty() || octree.isEmpty()) {
+		return 1;
+	}
+	compare_octree(quadtree, octree);
+	return 0;
+}
+
+}
+
+int
+main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Downloads a synthetic resource from a local mock greyhound server");
+	parser.addHelpOption();
+	const QCommandLineOption all("all", "Runs every scenario, each in its own process.");
+	const QCommandLineOption compare("compare-octree", "Runs the box with quadtree then octree and compares them.");
+	const QCommandLineOption method("method", "depth_by_depth, quadtree or octree.", "method", "octree");
+	const QCommandLineOption threads("threads", "Converter threads, 0 for one per core.", "threads", "0");
+	const QCommandLineOption bbox("bbox", "Side of the downloaded box over the side of the resource.", "fraction", "1");
+	const QCommandLineOption depths("depths", "Depths of the resource, the deepest holds 4^(depths + 3) points.", "depths", "8");
+	const QCommandLineOption start_depth("start-depth", "Deepest depth of the first request.", "depth", "3");
+	const QCommandLineOption latency("latency", "Milliseconds before each response.", "ms", "20");
+	const QCommandLineOption bandwidth("bandwidth", "MiB/s of each connection, 0 for no limit.", "MiB/s", "50");
+	const QCommandLineOption uncompressed("uncompressed", "Asks for uncompressed reads even when PDAL has laz-perf.");
+	parser.addOptions({ all, compare, method, threads, bbox, depths, start_depth, latency, bandwidth, uncompressed });
+	parser.process(app);
+
+	Settings settings;
+	settings.depths = parser.value(depths).toInt();
+	settings.start_depth = parser.value(start_depth).toInt();
+	settings.shape.latency_ms = parser.value(latency).toInt();
+	settings.shape.bytes_per_second = parser.value(bandwidth).toDouble() * (1 << 20);
+	settings.compressed = !parser.isSet(uncompressed);
+
+	QStringList shared_args{
+		"--depths", parser.value(depths),
+		"--start-depth", parser.value(start_depth),
+		"--latency", parser.value(latency),
+		"--bandwidth", parser.value(bandwidth)
+	};
+	if (!settings.compressed) {
+		shared_args << "--uncompressed";
+	}
+	if (parser.isSet(all)) {
+		return run_all(shared_args);
+	}
+
+	const Scenario scenario{ parser.value(method), parser.value(threads).toInt(), parser.value(bbox).toDouble() };
+	if (parser.isSet(compare)) {
+		return run_comparison(scenario, shared_args);
+	}
+	if (!Methods.count(scenario.method)) {
+		std::fprintf(stderr, "unknown method %s\n", qPrintable(scenario.method));
+		return 2;
+	}
+	try {
+		return run_scenario(scenario, settings);
+	}
+	catch (const std::exception& e) {
+		std::fprintf(stderr, "%s\n", e.what());
+		return 1;
+	}
+}
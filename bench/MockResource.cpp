@@ -0,0 +1,379 @@
+#include "MockResource.h"
+
+#include <algorithm>
+#include <cmath>
+#include <functional>
+#include <map>
+#include <set>
+#include <stdexcept>
+#include <type_traits>
+#include <vector>
+
+namespace {
+
+const double Pi = 3.14159265358979323846;
+const std::array<double, 3> Origin{ { 650000, 4850000, 0 } };
+const char* const OctantKeys[8] = { "swd", "sed", "nwd", "ned", "swu", "seu", "nwu", "neu" };
+
+uint64_t
+mix(uint64_t x)
+{
+	// splitmix64 finalizer
+	x += 0x9E3779B97F4A7C15ull;
+	x = (x ^ (x >> 30)) * 0xBF58476D1CE4E5B9ull;
+	x = (x ^ (x >> 27)) * 0x94D049BB133111EBull;
+	return x ^ (x >> 31);
+}
+
+// In [0, 1)
+double
+unit(const uint64_t bits)
+{
+	return static_cast<double>(bits >> 11) / static_cast<double>(1ull << 53);
+}
+
+enum class Field
+{
+	X, Y, Z, Intensity, Red, Green, Blue, Classification, GpsTime, Unknown
+};
+
+Field
+field_of(const std::string& name)
+{
+	static const std::map<std::string, Field> fields{
+		{ "X", Field::X }, { "Y", Field::Y }, { "Z", Field::Z },
+		{ "Intensity", Field::Intensity },
+		{ "Red", Field::Red }, { "Green", Field::Green }, { "Blue", Field::Blue },
+		{ "Classification", Field::Classification },
+		{ "GpsTime", Field::GpsTime }
+	};
+	const auto it = fields.find(name);
+	return it == fields.end() ? Field::Unknown : it->second;
+}
+
+enum class Packing
+{
+	Float, Double, Int8, Int16, Int32, Int64, UInt8, UInt16, UInt32, UInt64
+};
+
+Packing
+packing_of(const std::string& type, const unsigned size)
+{
+	if (type == "floating" && size == 4) return Packing::Float;
+	if (type == "floating" && size == 8) return Packing::Double;
+	if (type == "signed" && size == 1) return Packing::Int8;
+	if (type == "signed" && size == 2) return Packing::Int16;
+	if (type == "signed" && size == 4) return Packing::Int32;
+	if (type == "signed" && size == 8) return Packing::Int64;
+	if (type == "unsigned" && size == 1) return Packing::UInt8;
+	if (type == "unsigned" && size == 2) return Packing::UInt16;
+	if (type == "unsigned" && size == 4) return Packing::UInt32;
+	if (type == "unsigned" && size == 8) return Packing::UInt64;
+	throw std::invalid_argument("Unsupported dimension type " + type + std::to_string(size * 8));
+}
+
+template <typename T>
+void
+append_as(std::string& out, const double value)
+{
+	const T v = std::is_floating_point<T>::value ? static_cast<T>(value) : static_cast<T>(std::llround(value));
+	out.append(reinterpret_cast<const char*>(&v), sizeof(v));
+}
+
+void
+append(std::string& out, const Packing packing, const double value)
+{
+	switch (packing)
+	{
+	case Packing::Float: append_as<float>(out, value); break;
+	case Packing::Double: append_as<double>(out, value); break;
+	case Packing::Int8: append_as<int8_t>(out, value); break;
+	case Packing::Int16: append_as<int16_t>(out, value); break;
+	case Packing::Int32: append_as<int32_t>(out, value); break;
+	case Packing::Int64: append_as<int64_t>(out, value); break;
+	case Packing::UInt8: append_as<uint8_t>(out, value); break;
+	case Packing::UInt16: append_as<uint16_t>(out, value); break;
+	case Packing::UInt32: append_as<uint32_t>(out, value); break;
+	case Packing::UInt64: append_as<uint64_t>(out, value); break;
+	}
+}
+
+double
+field_value(const std::array<double, 3>& xyz, const uint64_t hash, const Field field)
+{
+	// Colors follow the height, from blue at the bottom of the surface to red at its top
+	const double t = std::min(1.0, std::max(0.0, ((xyz[2] - Origin[2]) / MockResource::Size - 0.1) / 0.2));
+	switch (field)
+	{
+	case Field::X: return xyz[0];
+	case Field::Y: return xyz[1];
+	case Field::Z: return xyz[2];
+	case Field::Intensity: return static_cast<double>((hash >> 16) & 0xFFFF);
+	case Field::Red: return std::round(65535 * t);
+	case Field::Green: return std::round(65535 * (1 - std::abs(2 * t - 1)));
+	case Field::Blue: return std::round(65535 * (1 - t));
+	case Field::Classification: return 2;
+	case Field::GpsTime: return 1.2e9 + static_cast<double>(hash % 3600000) / 1000.0;
+	case Field::Unknown: break;
+	}
+	return 0;
+}
+
+Json::Value
+dimension(const char *name, const char *type, const unsigned size)
+{
+	Json::Value dim;
+	dim["name"] = name;
+	dim["type"] = type;
+	dim["size"] = size;
+	return dim;
+}
+
+}
+
+MockBounds
+MockBounds::from_json(const Json::Value& json)
+{
+	if (!json.isArray() || json.size() != 6) {
+		throw std::invalid_argument("Bounds must be an array of 6 numbers");
+	}
+	MockBounds b;
+	for (Json::ArrayIndex i = 0; i < 3; ++i) {
+		if (!json[i].isNumeric() || !json[i + 3].isNumeric()) {
+			throw std::invalid_argument("Bounds must be an array of 6 numbers");
+		}
+		b.min[i] = json[i].asDouble();
+		b.max[i] = json[i + 3].asDouble();
+	}
+	return b;
+}
+
+Json::Value
+MockBounds::to_json() const
+{
+	Json::Value json(Json::arrayValue);
+	for (double v : { min[0], min[1], min[2], max[0], max[1], max[2] }) {
+		json.append(v);
+	}
+	return json;
+}
+
+bool
+MockBounds::contains(const std::array<double, 3>& p) const
+{
+	for (size_t k = 0; k < 3; ++k) {
+		if (p[k] < min[k] || p[k] >= max[k]) {
+			return false;
+		}
+	}
+	return true;
+}
+
+MockBounds
+MockBounds::octant(const int o) const
+{
+	MockBounds b(*this);
+	for (size_t k = 0; k < 3; ++k) {
+		const double mid = (min[k] + max[k]) / 2.0;
+		if (o & (1 << k)) {
+			b.min[k] = mid;
+		}
+		else {
+			b.max[k] = mid;
+		}
+	}
+	return b;
+}
+
+MockResource::MockResource(const int depths, const int base_side)
+	: m_depths(depths)
+	, m_base_side(base_side)
+{
+	for (size_t k = 0; k < 3; ++k) {
+		m_bounds.min[k] = Origin[k];
+		m_bounds.max[k] = Origin[k] + Size;
+	}
+}
+
+MockBounds
+MockResource::bounds() const
+{
+	return m_bounds;
+}
+
+uint64_t
+MockResource::num_points() const
+{
+	// Every point of the grids lands inside the cube
+	uint64_t total = 0;
+	for (int depth = 0; depth < m_depths; ++depth) {
+		const uint64_t side = static_cast<uint64_t>(m_base_side) << depth;
+		total += side * side;
+	}
+	return total;
+}
+
+Json::Value
+MockResource::info() const
+{
+	Json::Value schema(Json::arrayValue);
+	schema.append(dimension("X", "floating", 8));
+	schema.append(dimension("Y", "floating", 8));
+	schema.append(dimension("Z", "floating", 8));
+	schema.append(dimension("Intensity", "unsigned", 2));
+	schema.append(dimension("Red", "unsigned", 2));
+	schema.append(dimension("Green", "unsigned", 2));
+	schema.append(dimension("Blue", "unsigned", 2));
+	schema.append(dimension("Classification", "unsigned", 1));
+	schema.append(dimension("GpsTime", "floating", 8));
+
+	MockBounds conforming(m_bounds);
+	conforming.min[2] = Origin[2] + 0.1 * Size;
+	conforming.max[2] = Origin[2] + 0.3 * Size;
+
+	Json::Value info;
+	info["type"] = "octree";
+	info["numPoints"] = static_cast<Json::UInt64>(num_points());
+	info["schema"] = schema;
+	info["bounds"] = m_bounds.to_json();
+	info["boundsConforming"] = conforming.to_json();
+	info["srs"] = "";
+	info["baseDepth"] = 0;
+	return info;
+}
+
+double
+MockResource::surface(const double x, const double y) const
+{
+	const double u = (x - Origin[0]) / Size;
+	const double v = (y - Origin[1]) / Size;
+	return Origin[2] + Size * (0.2
+		+ 0.08 * std::sin(2 * Pi * u / 0.7) * std::cos(2 * Pi * v / 0.45)
+		+ 0.015 * std::sin(2 * Pi * (u + v) / 0.13));
+}
+
+template <typename F>
+void
+MockResource::for_each_point(const MockBounds& b, const int depth, F f) const
+{
+	if (depth < 0 || depth >= m_depths) {
+		return;
+	}
+	const int64_t side = static_cast<int64_t>(m_base_side) << depth;
+	const double cell = Size / static_cast<double>(side);
+
+	// Each point is jittered within the middle half of its cell
+	const auto first = [&](const size_t k) {
+		return std::max<int64_t>(0, static_cast<int64_t>(std::floor((b.min[k] - Origin[k]) / cell - 0.75)));
+	};
+	const auto last = [&](const size_t k) {
+		return std::min<int64_t>(side - 1, static_cast<int64_t>(std::floor((b.max[k] - Origin[k]) / cell - 0.25)));
+	};
+
+	const uint64_t seed = mix(static_cast<uint64_t>(depth));
+	const int64_t j_end = last(1);
+	const int64_t i_end = last(0);
+	for (int64_t j = first(1); j <= j_end; ++j) {
+		for (int64_t i = first(0); i <= i_end; ++i) {
+			Point p;
+			p.hash = mix(seed ^ mix(static_cast<uint64_t>(j) << 32 | static_cast<uint64_t>(i)));
+			p.xyz[0] = Origin[0] + (i + 0.25 + 0.5 * unit(p.hash)) * cell;
+			p.xyz[1] = Origin[1] + (j + 0.25 + 0.5 * unit(mix(p.hash))) * cell;
+			p.xyz[2] = surface(p.xyz[0], p.xyz[1]);
+			if (b.contains(p.xyz)) {
+				f(p);
+			}
+		}
+	}
+}
+
+uint64_t
+MockResource::count(const MockBounds& b, const int depth) const
+{
+	uint64_t n = 0;
+	for_each_point(b, depth, [&n](const Point&) { ++n; });
+	return n;
+}
+
+Json::Value
+MockResource::hierarchy(const MockBounds& b, const int depth_begin, const int depth_end) const
+{
+	// Nodes are keyed by their level below b and their octant path, 3 bits per level
+	using Node = std::pair<int, uint64_t>;
+	std::map<Node, uint64_t> counts;
+	std::set<Node> non_empty;
+
+	const int levels = std::min(depth_end - depth_begin, 21);
+	for (int level = 0; level < levels; ++level) {
+		for_each_point(b, depth_begin + level, [&](const Point& p) {
+			uint64_t path = 0;
+			MockBounds node(b);
+			non_empty.insert({ 0, 0 });
+			for (int l = 1; l <= level; ++l) {
+				int o = 0;
+				for (size_t k = 0; k < 3; ++k) {
+					if (p.xyz[k] >= (node.min[k] + node.max[k]) / 2.0) {
+						o |= 1 << k;
+					}
+				}
+				node = node.octant(o);
+				path = path << 3 | static_cast<uint64_t>(o);
+				non_empty.insert({ l, path });
+			}
+			++counts[{ level, path }];
+		});
+	}
+
+	std::function<Json::Value(int, uint64_t)> node_json = [&](const int level, const uint64_t path) {
+		Json::Value node(Json::objectValue);
+		const auto it = counts.find({ level, path });
+		node["n"] = static_cast<Json::UInt64>(it == counts.end() ? 0 : it->second);
+		if (level + 1 < levels) {
+			for (int o = 0; o < 8; ++o) {
+				const uint64_t child = path << 3 | static_cast<uint64_t>(o);
+				if (non_empty.count({ level + 1, child })) {
+					node[OctantKeys[o]] = node_json(level + 1, child);
+				}
+			}
+		}
+		return node;
+	};
+
+	if (!non_empty.count({ 0, 0 })) {
+		return Json::Value(Json::objectValue);
+	}
+	return node_json(0, 0);
+}
+
+std::string
+MockResource::read(const Json::Value& schema, const MockBounds& b, const int depth_begin, const int depth_end, uint32_t *count) const
+{
+	struct Dim
+	{
+		Field field;
+		Packing packing;
+	};
+	if (!schema.isArray()) {
+		throw std::invalid_argument("Schema must be an array");
+	}
+	std::vector<Dim> dims;
+	for (const auto& dim : schema) {
+		dims.push_back({ field_of(dim["name"].asString()), packing_of(dim["type"].asString(), dim["size"].asUInt()) });
+	}
+
+	std::string out;
+	uint32_t points = 0;
+	for (int depth = depth_begin; depth < depth_end; ++depth) {
+		for_each_point(b, depth, [&](const Point& p) {
+			for (const auto& dim : dims) {
+				append(out, dim.packing, field_value(p.xyz, p.hash, dim.field));
+			}
+			++points;
+		});
+	}
+	out.append(reinterpret_cast<const char*>(&points), sizeof(points));
+	if (count) {
+		*count = points;
+	}
+	return out;
+}
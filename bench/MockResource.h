@@ -0,0 +1,67 @@
+#pragma once
+
+#include <array>
+#include <cstdint>
+#include <string>
+
+#include <json/json.h>
+
+// Bounds as greyhound sends them, [minx, miny, minz, maxx, maxy, maxz]
+struct MockBounds
+{
+	std::array<double, 3> min;
+	std::array<double, 3> max;
+
+	// Throws std::invalid_argument unless json is an array of 6 numbers
+	static MockBounds from_json(const Json::Value& json);
+	Json::Value to_json() const;
+	// Half open, so that the octants of a node share none of its points
+	bool contains(const std::array<double, 3>& p) const;
+	// Same split and octant order as octant_bounds
+	MockBounds octant(int o) const;
+};
+
+// A synthetic terrain laid out as a greyhound octree, for benchmarks.
+//
+// Depth d holds a jittered grid of (base_side << d)^2 points over the
+// whole resource, each lifted onto a smooth surface in the lower third
+// of the cube, so that most octree nodes above it are empty, like over
+// real terrain. Points are computed from their grid cell, nothing is stored.
+class MockResource
+{
+public:
+	static constexpr double Size = 1024;
+
+	MockResource(int depths = 8, int base_side = 16);
+
+	int depths() const { return m_depths; }
+	MockBounds bounds() const;
+	uint64_t num_points() const;
+
+	// The /info response
+	Json::Value info() const;
+	// The /hierarchy response: b at depth_begin and its non empty octants
+	// down to depth_end - 1, each holding its point count in "n"
+	Json::Value hierarchy(const MockBounds& b, int depth_begin, int depth_end) const;
+	// The uncompressed /read response: the points of b from depth_begin up to
+	// depth_end packed as schema, followed by their count on 32 bits.
+	// Throws std::invalid_argument on a type it can't pack.
+	std::string read(const Json::Value& schema, const MockBounds& b, int depth_begin, int depth_end, uint32_t *count = nullptr) const;
+	// Points of b at depth
+	uint64_t count(const MockBounds& b, int depth) const;
+
+private:
+	struct Point
+	{
+		std::array<double, 3> xyz;
+		uint64_t hash;
+	};
+
+	template <typename F>
+	void for_each_point(const MockBounds& b, int depth, F f) const;
+	double surface(double x, double y) const;
+
+	int m_depths;
+	int m_base_side;
+	MockBounds m_bounds;
+};
@@ -0,0 +1,368 @@
+#include "MockServer.h"
+
+#include <QElapsedTimer>
+#include <QFutureWatcher>
+#include <QHostAddress>
+#include <QPointer>
+#include <QTcpServer>
+#include <QTcpSocket>
+#include <QTimer>
+#include <QUrl>
+#include <QUrlQuery>
+#include <QtConcurrent>
+
+#include <algorithm>
+
+#include <pdal/pdal_features.hpp>
+#ifdef PDAL_HAVE_LAZPERF
+#include <pdal/compression/LazPerfCompression.hpp>
+#endif
+
+// Bandwidth shaped responses are handed to the socket in slices this often
+static const int PaceMs = 10;
+
+QJsonObject
+MockCounters::to_json() const
+{
+	QJsonObject json;
+	json["info"] = static_cast<double>(info);
+	json["hierarchy"] = static_cast<double>(hierarchy);
+	json["reads"] = static_cast<double>(reads);
+	json["empty_reads"] = static_cast<double>(empty_reads);
+	json["points"] = static_cast<double>(points);
+	json["bytes"] = static_cast<double>(bytes);
+	json["errors"] = static_cast<double>(errors);
+	return json;
+}
+
+struct MockServer::Connection
+{
+	Connection()
+		: busy(false)
+		, close_after(false)
+		, sent(0)
+		, allowance(0)
+		, pacer(nullptr)
+	{}
+
+	QPointer<QTcpSocket> socket;
+	// Received and not parsed yet
+	QByteArray received;
+	bool busy;
+	bool close_after;
+	// The response being paced, and how much of it went to the socket
+	QByteArray pending;
+	int sent;
+	double allowance;
+	QElapsedTimer since_pace;
+	QTimer *pacer;
+};
+
+MockServer::MockServer(std::shared_ptr<const MockResource> resource, const LinkShape shape, std::shared_ptr<MockCounters> counters)
+	: m_resource(std::move(resource))
+	, m_shape(shape)
+	, m_counters(std::move(counters))
+	, m_server(new QTcpServer)
+{
+	QObject::connect(m_server, &QTcpServer::newConnection, [this]() { accept(); });
+}
+
+MockServer::~MockServer()
+{
+	delete m_server;
+	m_pool.waitForDone();
+}
+
+bool
+MockServer::listen(const quint16 port)
+{
+	return m_server->listen(QHostAddress::LocalHost, port);
+}
+
+quint16
+MockServer::port() const
+{
+	return m_server->serverPort();
+}
+
+QString
+MockServer::error() const
+{
+	return m_server->errorString();
+}
+
+void
+MockServer::accept()
+{
+	while (QTcpSocket *socket = m_server->nextPendingConnection()) {
+		auto c = std::make_shared<Connection>();
+		c->socket = socket;
+		c->pacer = new QTimer(socket);
+		c->pacer->setInterval(PaceMs);
+		QObject::connect(c->pacer, &QTimer::timeout, [this, c]() { pace(c); });
+		QObject::connect(socket, &QTcpSocket::readyRead, [this, c]() {
+			c->received += c->socket->readAll();
+			serve_next(c);
+		});
+		QObject::connect(socket, &QTcpSocket::disconnected, socket, &QObject::deleteLater);
+	}
+}
+
+void
+MockServer::serve_next(const std::shared_ptr<Connection>& c)
+{
+	if (c->busy || !c->socket) {
+		return;
+	}
+	const int header_end = c->received.indexOf("\r\n\r\n");
+	if (header_end < 0) {
+		return;
+	}
+	const QByteArray header = c->received.left(header_end);
+	c->received.remove(0, header_end + 4);
+	c->busy = true;
+
+	// GET <target> HTTP/1.1, the requests carry no body
+	const QList<QByteArray> request_line = header.left(header.indexOf("\r\n")).split(' ');
+	c->close_after = header.toLower().contains("connection: close");
+
+	QElapsedTimer waited;
+	waited.start();
+	if (request_line.size() < 2 || request_line[0] != "GET") {
+		Response bad;
+		bad.status = 400;
+		bad.body = "Only GET is served";
+		send(c, bad);
+		return;
+	}
+
+	const QByteArray target = request_line[1];
+	auto watcher = new QFutureWatcher<Response>(c->socket);
+	QObject::connect(watcher, &QFutureWatcher<Response>::finished, [this, c, watcher, waited]() {
+		const Response response = watcher->result();
+		watcher->deleteLater();
+		const int wait = std::max<int>(0, m_shape.latency_ms - static_cast<int>(waited.elapsed()));
+		if (!c->socket) {
+			return;
+		}
+		QTimer::singleShot(wait, c->socket.data(), [this, c, response]() { send(c, response); });
+	});
+	watcher->setFuture(QtConcurrent::run(&m_pool, [this, target]() { return respond(target); }));
+}
+
+void
+MockServer::send(const std::shared_ptr<Connection>& c, const Response& response)
+{
+	if (!c->socket) {
+		return;
+	}
+	const char *reason = response.status == 200 ? "OK" : response.status == 404 ? "Not Found" : "Bad Request";
+	QByteArray head = "HTTP/1.1 " + QByteArray::number(response.status) + " " + reason + "\r\n";
+	head += "Content-Type: " + (response.content_type.isEmpty() ? QByteArray("text/plain") : response.content_type) + "\r\n";
+	head += "Content-Length: " + QByteArray::number(response.body.size()) + "\r\n";
+	head += c->close_after ? "Connection: close\r\n\r\n" : "Connection: keep-alive\r\n\r\n";
+
+	if (m_shape.bytes_per_second <= 0) {
+		c->socket->write(head);
+		c->socket->write(response.body);
+		finish(c);
+		return;
+	}
+	c->pending = head + response.body;
+	c->sent = 0;
+	c->allowance = 0;
+	c->since_pace.start();
+	c->pacer->start();
+}
+
+void
+MockServer::pace(const std::shared_ptr<Connection>& c)
+{
+	if (!c->socket) {
+		return;
+	}
+	// What the link let through since the last slice, partial bytes carry over
+	c->allowance += m_shape.bytes_per_second * c->since_pace.restart() / 1000.0;
+	const int slice = std::min(static_cast<int>(c->allowance), c->pending.size() - c->sent);
+	if (slice > 0) {
+		c->socket->write(c->pending.constData() + c->sent, slice);
+		c->sent += slice;
+		c->allowance -= slice;
+	}
+	if (c->sent == c->pending.size()) {
+		c->pacer->stop();
+		c->pending.clear();
+		finish(c);
+	}
+}
+
+void
+MockServer::finish(const std::shared_ptr<Connection>& c)
+{
+	c->busy = false;
+	if (c->close_after) {
+		c->socket->disconnectFromHost();
+		return;
+	}
+	serve_next(c);
+}
+
+static std::string
+query_item(const QUrlQuery& query, const char *name)
+{
+	if (!query.hasQueryItem(name)) {
+		throw std::invalid_argument(std::string("Missing ") + name);
+	}
+	return query.queryItemValue(name, QUrl::FullyDecoded).toStdString();
+}
+
+static Json::Value
+json_item(const QUrlQuery& query, const char *name)
+{
+	Json::Value value;
+	Json::Reader reader;
+	if (!reader.parse(query_item(query, name), value, false)) {
+		throw std::invalid_argument(std::string(name) + " is not proper json");
+	}
+	return value;
+}
+
+static int
+int_item(const QUrlQuery& query, const char *name)
+{
+	return std::stoi(query_item(query, name));
+}
+
+static QByteArray
+to_bytes(const Json::Value& json)
+{
+	Json::FastWriter writer;
+	return QByteArray::fromStdString(writer.write(json));
+}
+
+#ifdef PDAL_HAVE_LAZPERF
+// Compresses the points of an uncompressed /read response packed as schema,
+// the point count stays last and uncompressed, as greyhound sends it
+static std::string
+laz_perf_compressed(const std::string& read, const Json::Value& schema)
+{
+	pdal::DimTypeList dim_types;
+	for (const auto& dim : schema) {
+		const std::string type = dim["type"].asString();
+		const auto base = type == "signed" ? pdal::Dimension::BaseType::Signed
+			: type == "unsigned" ? pdal::Dimension::BaseType::Unsigned
+			: pdal::Dimension::BaseType::Floating;
+		dim_types.emplace_back(pdal::Dimension::Id::Unknown, static_cast<pdal::Dimension::Type>(static_cast<unsigned>(base) | dim["size"].asUInt()));
+	}
+
+	const size_t points_size = read.size() - sizeof(uint32_t);
+	std::string out;
+	pdal::LazPerfCompressor compressor([&out](char *buf, size_t size) { out.append(buf, size); }, dim_types);
+	compressor.compress(read.data(), points_size);
+	compressor.done();
+	out.append(read.data() + points_size, sizeof(uint32_t));
+	return out;
+}
+#endif
+
+MockServer::Response
+MockServer::respond(const QByteArray& target) const
+{
+	const QUrl url = QUrl::fromEncoded(target);
+	const QUrlQuery query(url);
+	const QString path = url.path();
+
+	Response response;
+	try {
+		if (path.endsWith("/info")) {
+			++m_counters->info;
+			response.content_type = "application/json";
+			response.body = to_bytes(m_resource->info());
+		}
+		else if (path.endsWith("/hierarchy")) {
+			++m_counters->hierarchy;
+			response.content_type = "application/json";
+			response.body = to_bytes(m_resource->hierarchy(MockBounds::from_json(json_item(query, "bounds")), int_item(query, "depthBegin"), int_item(query, "depthEnd")));
+		}
+		else if (path.endsWith("/read")) {
+			++m_counters->reads;
+			const bool compress = query.hasQueryItem("compress") && query.queryItemValue("compress") == "true";
+#ifndef PDAL_HAVE_LAZPERF
+			if (compress) {
+				throw std::invalid_argument("The mock only serves compressed reads when PDAL has laz-perf");
+			}
+#endif
+			const Json::Value schema = json_item(query, "schema");
+			uint32_t count = 0;
+			std::string points = m_resource->read(schema, MockBounds::from_json(json_item(query, "bounds")), int_item(query, "depthBegin"), int_item(query, "depthEnd"), &count);
+			if (!count) {
+				++m_counters->empty_reads;
+			}
+#ifdef PDAL_HAVE_LAZPERF
+			if (compress) {
+				points = laz_perf_compressed(points, schema);
+			}
+#endif
+			m_counters->points += count;
+			response.content_type = "application/octet-stream";
+			response.body = QByteArray(points.data(), static_cast<int>(points.size()));
+		}
+		else {
+			response.status = 404;
+			response.body = "Unknown endpoint " + path.toUtf8();
+		}
+	}
+	catch (const std::exception& e) {
+		response.status = 400;
+		response.body = e.what();
+	}
+	if (response.status != 200) {
+		++m_counters->errors;
+	}
+	m_counters->bytes += static_cast<uint64_t>(response.body.size());
+	return response;
+}
+
+MockServerThread::MockServerThread(std::shared_ptr<const MockResource> resource, const LinkShape shape)
+	: m_resource(std::move(resource))
+	, m_shape(shape)
+	, m_counters(std::make_shared<MockCounters>())
+	, m_requested_port(0)
+	, m_port(0)
+{
+}
+
+MockServerThread::~MockServerThread()
+{
+	quit();
+	wait();
+}
+
+bool
+MockServerThread::start_listening(const quint16 port)
+{
+	m_requested_port = port;
+	std::future<quint16> listening = m_listening.get_future();
+	start();
+	m_port = listening.get();
+	return m_port != 0;
+}
+
+QString
+MockServerThread::url() const
+{
+	return QString("http://127.0.0.1:%1/resource/mock").arg(m_port);
+}
+
+void
+MockServerThread::run()
+{
+	MockServer server(m_resource, m_shape, m_counters);
+	if (!server.listen(m_requested_port)) {
+		qWarning("mock greyhound: %s", qPrintable(server.error()));
+		m_listening.set_value(0);
+		return;
+	}
+	m_listening.set_value(server.port());
+	exec();
+}
@@ -0,0 +1,125 @@
+#pragma once
+
+#include <atomic>
+#include <future>
+#include <memory>
+
+#include <QJsonObject>
+#include <QString>
+#include <QThread>
+#include <QThreadPool>
+
+#include "MockResource.h"
+
+class QTcpServer;
+class QTcpSocket;
+
+// How every connection of the server behaves, 0 means no limit
+struct LinkShape
+{
+	LinkShape()
+		: latency_ms(0)
+		, bytes_per_second(0)
+	{}
+
+	// Between a request and the first byte of its response
+	int latency_ms;
+	// Of each connection, as browsers and QNetworkAccessManager open several
+	double bytes_per_second;
+};
+
+// What the server was asked, updated from its threads
+struct MockCounters
+{
+	MockCounters()
+		: info(0)
+		, hierarchy(0)
+		, reads(0)
+		, empty_reads(0)
+		, points(0)
+		, bytes(0)
+		, errors(0)
+	{}
+
+	QJsonObject to_json() const;
+
+	std::atomic<uint64_t> info;
+	std::atomic<uint64_t> hierarchy;
+	std::atomic<uint64_t> reads;
+	// Reads answered with no point, requests a hierarchy aware download avoids
+	std::atomic<uint64_t> empty_reads;
+	std::atomic<uint64_t> points;
+	// Of the response bodies
+	std::atomic<uint64_t> bytes;
+	std::atomic<uint64_t> errors;
+};
+
+// A minimal HTTP/1.1 server answering /info, /hierarchy and /read queries on a
+// MockResource, for any resource name. Reads are laz-perf compressed when asked
+// and PDAL has laz-perf. Connections are kept alive
+// and each one is shaped by the LinkShape. Responses are built on a pool of
+// its own, so that a slow /read does not hold the other connections.
+// Lives in the thread whose event loop runs it.
+class MockServer
+{
+public:
+	MockServer(std::shared_ptr<const MockResource> resource, LinkShape shape, std::shared_ptr<MockCounters> counters);
+	~MockServer();
+
+	// On localhost, 0 picks a free port
+	bool listen(quint16 port = 0);
+	quint16 port() const;
+	QString error() const;
+
+private:
+	struct Connection;
+	struct Response
+	{
+		Response()
+			: status(200)
+		{}
+
+		int status;
+		QByteArray content_type;
+		QByteArray body;
+	};
+
+	void accept();
+	// Starts answering the next complete request of c, if it is not busy with one
+	void serve_next(const std::shared_ptr<Connection>& c);
+	void send(const std::shared_ptr<Connection>& c, const Response& response);
+	void pace(const std::shared_ptr<Connection>& c);
+	void finish(const std::shared_ptr<Connection>& c);
+	Response respond(const QByteArray& target) const;
+
+	std::shared_ptr<const MockResource> m_resource;
+	LinkShape m_shape;
+	std::shared_ptr<MockCounters> m_counters;
+	QTcpServer *m_server;
+	QThreadPool m_pool;
+};
+
+// Runs a MockServer in a thread of its own, as the downloader blocks the one calling it
+class MockServerThread : public QThread
+{
+public:
+	MockServerThread(std::shared_ptr<const MockResource> resource, LinkShape shape);
+	~MockServerThread() override;
+
+	// Starts the thread and waits for the server to listen, false if it could not
+	bool start_listening(quint16 port = 0);
+	// Url of the resource, as the plugin expects it
+	QString url() const;
+	const MockCounters& counters() const { return *m_counters; }
+
+protected:
+	void run() override;
+
+private:
+	std::shared_ptr<const MockResource> m_resource;
+	LinkShape m_shape;
+	std::shared_ptr<MockCounters> m_counters;
+	quint16 m_requested_port;
+	std::promise<quint16> m_listening;
+	quint16 m_port;
+};
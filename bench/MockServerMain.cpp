@@ -0,0 +1,38 @@
+// Serves the synthetic resource of the benchmark on localhost,
+// to point qGreyhound or any greyhound client at it
+
+#include <QCommandLineParser>
+#include <QCoreApplication>
+
+#include <cstdio>
+
+#include "MockServer.h"
+
+int
+main(int argc, char *argv[])
+{
+	QCoreApplication app(argc, argv);
+
+	QCommandLineParser parser;
+	parser.setApplicationDescription("Local mock greyhound server");
+	parser.addHelpOption();
+	const QCommandLineOption port("port", "Port to listen on, 0 picks a free one.", "port", "8080");
+	const QCommandLineOption depths("depths", "Depths of the resource, the deepest holds 4^(depths + 3) points.", "depths", "8");
+	const QCommandLineOption latency("latency", "Milliseconds before each response.", "ms", "0");
+	const QCommandLineOption bandwidth("bandwidth", "MiB/s of each connection, 0 for no limit.", "MiB/s", "0");
+	parser.addOptions({ port, depths, latency, bandwidth });
+	parser.process(app);
+
+	LinkShape shape;
+	shape.latency_ms = parser.value(latency).toInt();
+	shape.bytes_per_second = parser.value(bandwidth).toDouble() * (1 << 20);
+
+	MockServer server(std::make_shared<const MockResource>(parser.value(depths).toInt()), shape, std::make_shared<MockCounters>());
+	if (!server.listen(static_cast<quint16>(parser.value(port).toUInt()))) {
+		std::fprintf(stderr, "could not listen: %s\n", qPrintable(server.error()));
+		return 1;
+	}
+	std::printf("serving http://127.0.0.1:%u/resource/mock\n", static_cast<unsigned>(server.port()));
+	std::fflush(stdout);
+	return app.exec();
+}
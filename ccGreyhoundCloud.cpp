@@ -46,3 +46,14 @@ ccGreyhoundCloud::State ccGreyhoundCloud::state() const
 	return m_state;
 }
 
+
+
+void ccGreyhoundCloud::add_tiles(const std::vector<TileRange>& tiles)
+{
+	m_tiles.insert(m_tiles.end(), tiles.begin(), tiles.end());
+}
+
+const std::vector<TileRange>& ccGreyhoundCloud::tiles() const
+{
+	return m_tiles;
+}
\ No newline at end of file
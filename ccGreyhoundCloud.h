@@ -10,6 +10,16 @@ class ccGreyhoundResource;
 
 namespace Greyhound = pdal::greyhound;
 
+// A query whose points sit at [first_index, first_index + count) of a cloud
+struct TileRange
+{
+	Greyhound::Bounds b;
+	int depth_begin;
+	int depth_end;
+	unsigned first_index;
+	unsigned count;
+};
+
 class ccGreyhoundCloud : public ccPointCloud {
 public:
 	enum class State
@@ -24,15 +34,19 @@ public:
 	void set_bbox(const Greyhound::Bounds bbox);
 	void set_origin(ccGreyhoundResource *origin);
 	void set_state(State state);
+	// Records where the points of a query went, to query them again for more dimensions
+	void add_tiles(const std::vector<TileRange>& tiles);
 
 	const Greyhound::Bounds& bbox() const;
 	std::vector<QString> available_dims() const;
 	const ccGreyhoundResource *origin() const;
 	State state() const;
+	const std::vector<TileRange>& tiles() const;
 
 
 private:
 	Greyhound::Bounds m_bbox;
 	ccGreyhoundResource *m_origin;
 	State m_state;
+	std::vector<TileRange> m_tiles;
 };
\ No newline at end of file
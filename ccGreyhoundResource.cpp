@@ -1,90 +1,109 @@
 #include <QJsonDocument>
 #include <QJsonArray>
-#include <QEventLoop>
+#include <QCryptographicHash>
 
 #include "ccGreyhoundResource.h"
 
-QString resource_name_from_url(const QString& url) 
+namespace {
+
+CCVector3d
+vector_at(const QJsonArray& values, const int first)
 {
-	QStringList splits = url.split('/');
-	return splits.at(splits.size() - 1);
+	return { values.at(first).toDouble(), values.at(first + 1).toDouble(), values.at(first + 2).toDouble() };
 }
 
-QJsonObject greyhound_info(const QUrl& url)
+// Greyhound gives the scale either once for all axes or per axis
+CCVector3d
+parse_scale(const QJsonValue& scale)
 {
-	QNetworkAccessManager qnam;
-	QNetworkRequest request;
-
-	const QUrl info_url(url.toString() + "/info");
-	request.setUrl(info_url);
-	QNetworkReply *reply = qnam.get(request);
-
-	QEventLoop loop;
-	QObject::connect(reply, &QNetworkReply::finished, &loop, &QEventLoop::quit);
-	loop.exec();
-
-	if (reply->error() != QNetworkReply::NoError) {
-		throw std::runtime_error(reply->errorString().toStdString());
+	if (scale.isArray()) {
+		return vector_at(scale.toArray(), 0);
 	}
-
-	auto document = QJsonDocument::fromJson(reply->readAll());
-	
-	if (!document.isObject()) {
-		throw std::runtime_error("Received info is not a proper json object");
-	}
-	return document.object();
+	const double s = scale.toDouble(1.0);
+	return { s, s, s };
 }
 
-
-
-ccGreyhoundResource::ccGreyhoundResource(QUrl url)
-	: ccCustomHObject(QString("[Greyhound] %1").arg(resource_name_from_url(url.toString())))
-	, m_url(std::move(url))
-	, m_info(greyhound_info(m_url))
-{
 }
 
-GreyhoundInfo::GreyhoundInfo(const const QJsonObject& info)
-	: m_info(info)
+QString resource_name_from_url(const QString& url) 
 {
+	QStringList splits = url.split('/');
+	return splits.at(splits.size() - 1);
 }
 
-std::vector<QString> GreyhoundInfo::available_dim_name() const
+void request_greyhound_info(QNetworkAccessManager& qnam, const QUrl& url, const QByteArray& etag, std::function<void(const InfoReply&)> done)
 {
-	QJsonArray schema = m_info.value("schema").toArray();
-	std::vector<QString> dim_names;
-	dim_names.reserve(schema.size());
-	for (const auto& dimension : schema) {
-		QJsonObject dimension_infos = dimension.toObject();
-		dim_names.push_back(dimension_infos.value("name").toString());
+	QNetworkRequest request(QUrl(url.toString() + "/info"));
+	if (!etag.isEmpty()) {
+		request.setRawHeader("If-None-Match", etag);
 	}
-	return dim_names;
-}
+	QNetworkReply *reply = qnam.get(request);
 
-int GreyhoundInfo::base_depth() const
-{
-	return m_info.value("baseDepth").toInt();
+	QObject::connect(reply, &QNetworkReply::finished, [reply, done]() {
+		reply->deleteLater();
+
+		InfoReply answer;
+		if (reply->error() != QNetworkReply::NoError) {
+			answer.error = reply->errorString();
+		}
+		else if (reply->attribute(QNetworkRequest::HttpStatusCodeAttribute).toInt() == 304) {
+			answer.not_modified = true;
+		}
+		else {
+			answer.body = reply->readAll();
+			answer.etag = reply->rawHeader("ETag");
+			const auto document = QJsonDocument::fromJson(answer.body);
+			if (document.isObject()) {
+				answer.info = document.object();
+			}
+			else {
+				answer.error = "Received info is not a proper json object";
+			}
+		}
+		done(answer);
+	});
 }
 
-CCVector3d GreyhoundInfo::offset() const
-{
-	QJsonArray offset = m_info.value("offset").toArray();
-	return { offset.at(0).toDouble(), offset.at(1).toDouble(), offset.at(2).toDouble() };
-}
 
-CCVector3d GreyhoundInfo::bounds_conforming_min() const
+
+ccGreyhoundResource::ccGreyhoundResource(QUrl url, GreyhoundInfo info)
+	: ccCustomHObject(QString("[Greyhound] %1").arg(resource_name_from_url(url.toString())))
+	, m_url(std::move(url))
+	, m_info(std::move(info))
+	, m_tile_cache(std::make_shared<TileCache>(m_url.toString(), m_info.digest()))
 {
-	QJsonArray bounds_conforming = m_info.value("boundsConforming").toArray();
-	return { bounds_conforming.at(0).toDouble(), bounds_conforming.at(1).toDouble(), bounds_conforming.at(2).toDouble() };
 }
 
-CCVector3d GreyhoundInfo::bounds_min() const
+void ccGreyhoundResource::set_info(GreyhoundInfo info)
 {
-	QJsonArray bounds = m_info.value("bounds").toArray();
-	return { bounds.at(0).toDouble(), bounds.at(1).toDouble(), bounds.at(2).toDouble() };
+	m_info = std::move(info);
+	// Downloads still running keep the old cache alive until they end
+	m_tile_cache = std::make_shared<TileCache>(m_url.toString(), m_info.digest());
 }
 
-QString GreyhoundInfo::srs() const
+GreyhoundInfo::GreyhoundInfo(const QJsonObject& info)
+	: m_base_depth(info.value("baseDepth").toInt())
+	, m_num_points(static_cast<uint64_t>(info.value("numPoints").toDouble()))
+	, m_offset(vector_at(info.value("offset").toArray(), 0))
+	, m_scale(parse_scale(info.value("scale")))
+	, m_bounds_conforming_min(vector_at(info.value("boundsConforming").toArray(), 0))
+	, m_bounds_min(vector_at(info.value("bounds").toArray(), 0))
+	, m_bounds_max(vector_at(info.value("bounds").toArray(), 3))
+	, m_srs(info.value("srs").toString())
 {
-	return m_info.value("srs").toString();
+	const QJsonArray schema = info.value("schema").toArray();
+	m_schema.reserve(schema.size());
+	m_dim_names.reserve(schema.size());
+	for (const auto& dimension : schema) {
+		const QJsonObject dimension_infos = dimension.toObject();
+		m_schema.push_back({
+			dimension_infos.value("name").toString(),
+			dimension_infos.value("type").toString(),
+			dimension_infos.value("size").toInt()
+		});
+		m_dim_names.push_back(m_schema.back().name);
+	}
+
+	const QByteArray json = QJsonDocument(info).toJson(QJsonDocument::Compact);
+	m_digest = QCryptographicHash::hash(json, QCryptographicHash::Sha1).toHex();
 }
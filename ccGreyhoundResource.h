@@ -4,30 +4,58 @@
 #include <QJsonObject>
 #include <QIcon>
 
+#include <functional>
+#include <memory>
+
 #include <ccCustomObject.h>
 
 #include "constants.h"
+#include "TileCache.h"
+
+struct GreyhoundDimension
+{
+	QString name;
+	QString type;
+	int size;
+};
 
+// The resource's /info, parsed once
 class GreyhoundInfo
 {
 public:
-	explicit GreyhoundInfo(const QJsonObject& info); 
-	int base_depth() const;
-	std::vector<QString> available_dim_name() const;
-	CCVector3d offset() const;
-	CCVector3d bounds_conforming_min() const;
-	CCVector3d bounds_min() const;
-	QString srs() const;
+	explicit GreyhoundInfo(const QJsonObject& info);
+	int base_depth() const { return m_base_depth; }
+	uint64_t num_points() const { return m_num_points; }
+	const std::vector<GreyhoundDimension>& schema() const { return m_schema; }
+	const std::vector<QString>& available_dim_name() const { return m_dim_names; }
+	const CCVector3d& offset() const { return m_offset; }
+	const CCVector3d& scale() const { return m_scale; }
+	const CCVector3d& bounds_conforming_min() const { return m_bounds_conforming_min; }
+	const CCVector3d& bounds_min() const { return m_bounds_min; }
+	const CCVector3d& bounds_max() const { return m_bounds_max; }
+	const QString& srs() const { return m_srs; }
+	// Changes whenever the resource's /info does
+	const QByteArray& digest() const { return m_digest; }
 
 private:
-	QJsonObject m_info;
+	int m_base_depth;
+	uint64_t m_num_points;
+	std::vector<GreyhoundDimension> m_schema;
+	std::vector<QString> m_dim_names;
+	CCVector3d m_offset;
+	CCVector3d m_scale;
+	CCVector3d m_bounds_conforming_min;
+	CCVector3d m_bounds_min;
+	CCVector3d m_bounds_max;
+	QString m_srs;
+	QByteArray m_digest;
 };
 
 
 class ccGreyhoundResource : public ccCustomHObject
 {
 public:
-	explicit ccGreyhoundResource(QUrl url);
+	ccGreyhoundResource(QUrl url, GreyhoundInfo info);
 	bool isSerializable() const override { return false; };
 	static QString DefautMetaDataClassName() { return "qGreyHoundResource"; };
 	static QString DefaultMetaDataPluginName() { return "qGreyhound"; };
@@ -35,12 +63,29 @@ public:
 
 	QUrl url() const { return m_url; }
 	const GreyhoundInfo& info() const { return m_info; }
+	// Replaces an info that turned out to be stale, the tile cache follows
+	void set_info(GreyhoundInfo info);
+	std::shared_ptr<TileCache> tile_cache() const { return m_tile_cache; }
 
 private:
 	QUrl m_url;
 	GreyhoundInfo m_info;
+	std::shared_ptr<TileCache> m_tile_cache;
 };
 
 
+struct InfoReply
+{
+	// Empty on success
+	QString error;
+	// The etag sent still matches, body and info are empty
+	bool not_modified = false;
+	QByteArray body;
+	QByteArray etag;
+	QJsonObject info;
+};
+
 QString resource_name_from_url(const QString& url);
-QJsonObject greyhound_info(const QUrl& url);
\ No newline at end of file
+// Asks for url's /info without blocking, done is called from the event loop
+// once the answer is in. A non empty etag makes the request conditional.
+void request_greyhound_info(QNetworkAccessManager& qnam, const QUrl& url, const QByteArray& etag, std::function<void(const InfoReply&)> done);
@@ -21,21 +21,27 @@
 #include <QInputDialog>
 #include <QEventLoop>
 #include <QtConcurrent>
+#include <QJsonDocument>
 
 #include <array>
+#include <chrono>
 #include <queue>
 
-#include <GreyhoundReader.hpp>
 #include <bounds.hpp>
 
 #include <ccHObject.h>
 #include <ccScalarField.h>
 #include <ccColorScalesManager.h>
+#include <ccGLWindow.h>
+#include <DgmOctree.h>
 
 #include "qGreyhound.h"
+#include "DeletionWatcher.h"
 #include "DimensionDialog.h"
 #include "PDALConverter.h"
 #include "GreyhoundDownloader.h"
+#include "ProgressiveDisplay.h"
+#include "InfoCache.h"
 #include "constants.h"
 
 #include "ui_bbox_form.h"
@@ -45,6 +51,10 @@ qGreyhound::qGreyhound(QObject* parent/*=0*/)
 	, ccStdPluginInterface(":/CC/plugin/qGreyhound/info.json")
 	, m_download_bounding_box(nullptr)
 	, m_connect_to_resource(nullptr)
+	, m_cancel_download(nullptr)
+	, m_stream_view(nullptr)
+	, m_cancel(std::make_shared<CancelToken>())
+	, m_network(new QNetworkAccessManager(this))
 {
 }
 
@@ -54,10 +64,11 @@ void qGreyhound::onNewSelection(const ccHObject::Container& selectedEntities)
 		auto *is_ressource = dynamic_cast<ccGreyhoundResource*>(selectedEntities.at(0));
 		auto *is_cloud = dynamic_cast<ccGreyhoundCloud*>(selectedEntities.at(0));
 		m_download_bounding_box->setEnabled(is_ressource || (is_cloud && is_cloud->state() == ccGreyhoundCloud::State::Idle));
-
+		m_stream_view->setEnabled(is_ressource || m_stream);
 	}
 	else {
 		m_download_bounding_box->setEnabled(false);
+		m_stream_view->setEnabled(m_stream != nullptr);
 	}
 }
 
@@ -78,7 +89,22 @@ QList<QAction*> qGreyhound::getActions()
 		connect(m_download_bounding_box, &QAction::triggered, this, &qGreyhound::download_bounding_box);
 	}
 
-	return { m_connect_to_resource, m_download_bounding_box };
+	if (!m_cancel_download) {
+		m_cancel_download = new QAction("Cancel download", this);
+		m_cancel_download->setToolTip("Stop the running download, keeping the points already received");
+		m_cancel_download->setEnabled(false);
+		connect(m_cancel_download, &QAction::triggered, this, &qGreyhound::cancel_download);
+	}
+
+	if (!m_stream_view) {
+		m_stream_view = new QAction("Stream view", this);
+		m_stream_view->setToolTip("Keep loaded the points of the selected resource that the 3D view needs");
+		m_stream_view->setCheckable(true);
+		m_stream_view->setEnabled(false);
+		connect(m_stream_view, &QAction::toggled, this, &qGreyhound::toggle_view_stream);
+	}
+
+	return { m_connect_to_resource, m_download_bounding_box, m_cancel_download, m_stream_view };
 }
 
 std::vector<QString> ask_for_dimensions(const std::vector<QString>& available_dims)
@@ -91,7 +117,16 @@ std::vector<QString> ask_for_dimensions(const std::vector<QString>& available_di
 	return dm.checked_dimensions();
 }
 
-pdal::greyhound::Bounds ask_for_bbox()
+struct BboxRequest
+{
+	pdal::greyhound::Bounds bounds;
+	GreyhoundDownloader::DownloadMethod method;
+	MemoryBudget budget;
+	StopCriteria stop;
+	PDALConverter::ColorDepth color_depth;
+};
+
+BboxRequest ask_for_bbox()
 {
 	QEventLoop loop;
 	Ui::BboxDialog ui;
@@ -101,12 +136,20 @@ pdal::greyhound::Bounds ask_for_bbox()
 	d.show();
 	loop.exec();
 
+	BboxRequest request;
+	request.method = static_cast<GreyhoundDownloader::DownloadMethod>(ui.method->currentIndex());
+	request.budget.max_bytes = static_cast<size_t>(ui.budget->value()) << 20;
+	request.stop.max_points = static_cast<size_t>(ui.max_points->value()) * 1000000;
+	request.stop.spacing = ui.spacing->value();
+	request.stop.max_depth = ui.max_depth->value();
+	request.color_depth = static_cast<PDALConverter::ColorDepth>(ui.color_depth->currentIndex());
+
 	if (ui.xmin->text().isEmpty() ||
 		ui.ymin->text().isEmpty() ||
 		ui.xmax->text().isEmpty() ||
 		ui.ymax->text().isEmpty())
 	{
-		return {};
+		return request;
 	}
 
 	double xmin = ui.xmin->text().toDouble();
@@ -122,7 +165,8 @@ pdal::greyhound::Bounds ask_for_bbox()
 		std::swap(ymin, ymax);
 	}
 
-	return { xmin, ymin, xmax, ymax };
+	request.bounds = { xmin, ymin, xmax, ymax };
+	return request;
 }
 
 
@@ -151,16 +195,112 @@ void qGreyhound::connect_to_resource() const
 		return;
 	}
 
-	ccGreyhoundResource *resource;
-	try {
-		resource = new ccGreyhoundResource(url);
+	// A resource seen before shows up at once from the cached /info,
+	// which is then only revalidated
+	const InfoCache cache;
+	QByteArray cached_body;
+	QByteArray cached_etag;
+	unsigned resource_id = 0;
+	if (cache.load(url, cached_body, cached_etag)) {
+		const auto document = QJsonDocument::fromJson(cached_body);
+		if (document.isObject()) {
+			auto *resource = new ccGreyhoundResource(url, GreyhoundInfo(document.object()));
+			resource_id = resource->getUniqueID();
+			m_app->addToDB(resource);
+		}
+		else {
+			cached_etag.clear();
+		}
 	}
-	catch (const std::exception& e) {
-		m_app->dispToConsole(e.what(), ccMainAppInterface::ERR_CONSOLE_MESSAGE);
+
+	request_greyhound_info(*m_network, url, resource_id ? cached_etag : QByteArray(), [=](const InfoReply& reply) {
+		if (!reply.error.isEmpty()) {
+			const QString message = resource_id
+				? QString("[qGreyhound] could not revalidate the info of %1: %2").arg(url.toString(), reply.error)
+				: reply.error;
+			m_app->dispToConsole(message, resource_id ? ccMainAppInterface::WRN_CONSOLE_MESSAGE : ccMainAppInterface::ERR_CONSOLE_MESSAGE);
+			return;
+		}
+		if (reply.not_modified) {
+			return;
+		}
+
+		cache.store(url, reply.body, reply.etag);
+		if (!resource_id) {
+			m_app->addToDB(new ccGreyhoundResource(url, GreyhoundInfo(reply.info)));
+			return;
+		}
+		if (reply.body == cached_body) {
+			return;
+		}
+		// The user may have removed the resource in the meantime
+		auto *resource = dynamic_cast<ccGreyhoundResource*>(m_app->dbRootObject()->find(resource_id));
+		if (resource) {
+			resource->set_info(GreyhoundInfo(reply.info));
+			m_app->dispToConsole(QString("[qGreyhound] the info of %1 changed since last time, updated it").arg(url.toString()));
+		}
+	});
+}
+
+void qGreyhound::cancel_download() const
+{
+	m_app->dispToConsole("[qGreyhound] cancelling the download");
+	m_cancel->cancel();
+}
+
+void qGreyhound::toggle_view_stream(const bool enabled)
+{
+	if (!enabled) {
+		m_stream.reset();
+		return;
+	}
+	if (m_stream) {
+		return;
+	}
+
+	const auto& selected_ent = m_app->getSelectedEntities();
+	auto resource = selected_ent.size() == 1 ? dynamic_cast<ccGreyhoundResource*>(selected_ent.at(0)) : nullptr;
+	ccGLWindow *window = m_app->getActiveGLWindow();
+	if (!resource || !window) {
+		m_app->dispToConsole("[qGreyhound] select a resource and a 3D view to stream", ccMainAppInterface::ERR_CONSOLE_MESSAGE);
+		m_stream_view->setChecked(false);
 		return;
 	}
 
-	m_app->addToDB(resource);
+	const auto requested_dims(ask_for_dimensions(resource->info().available_dim_name()));
+	if (requested_dims.empty()) {
+		m_app->dispToConsole("[qGreyhound] no dimensions were selected");
+		m_stream_view->setChecked(false);
+		return;
+	}
+	Json::Value dims(Json::arrayValue);
+	for (const auto& name : requested_dims) {
+		dims.append(Json::Value(name.toStdString()));
+	}
+
+	pdal::Options opts;
+	opts.add("url", resource->url().toString().toStdString());
+	opts.add("dims", dims);
+
+	const auto shift = resource->info().bounds_conforming_min();
+	PDALConverter converter;
+	converter.set_shift(shift);
+
+	const auto min = resource->info().bounds_min();
+	const auto max = resource->info().bounds_max();
+	StreamingPlanner planner(
+		{ min.x, min.y, min.z, max.x, max.y, max.z },
+		resource->info().base_depth(),
+		CCLib::DgmOctree::MAX_OCTREE_LEVEL,
+		shift
+	);
+
+	auto group = new ccHObject("View stream");
+	resource->addChild(group);
+	m_app->addToDB(group);
+
+	m_stream.reset(new ViewStream(m_app, window, group, planner, opts, resource->info().schema(), converter, resource->tile_cache()));
+	m_stream->start();
 }
 
 void qGreyhound::download_bounding_box() const
@@ -201,23 +341,37 @@ void qGreyhound::download_bounding_box() const
 	}
 
 
-	auto bounds = ask_for_bbox();
+	const auto request = ask_for_bbox();
+	const auto requested_at = std::chrono::steady_clock::now();
+	const auto method = request.method;
+	auto bounds = request.bounds;
 	if (bounds.empty()) {
 		m_app->dispToConsole("[qGreyhound] Empty bbox");
 		bounds = { 1415593.910970612, 4184732.482818023,1415620.5006109416, 4184752.4613910406, };
 	}
 
+	if (method == GreyhoundDownloader::DownloadMethod::Octree) {
+		// Octree nodes are split along z too, so they need the resource's vertical extent
+		const auto zmin = resource->info().bounds_min().z;
+		const auto zmax = resource->info().bounds_max().z;
+		bounds = { bounds.min().x, bounds.min().y, zmin, bounds.max().x, bounds.max().y, zmax };
+	}
+
 
 	const auto shift = resource->info().bounds_conforming_min();
 	PDALConverter converter;
 	converter.set_shift(shift);
+	converter.set_color_depth(request.color_depth);
 	pdal::Options opts;
 	opts.add("url", resource->url().toString().toStdString());
 	opts.add("dims", dims);
 
 	auto cloud = new ccGreyhoundCloud("Cloud (downloading...)");
 	cloud->set_state((ccGreyhoundCloud::State::WaitingForPoints));
+	const auto trace = std::make_shared<TileTrace>();
 	// We download the first depth separately here to be able to add it to cc's DB
+	int first_color_shift = 0;
+	unsigned first_points = 0;
 	{
 		pdal::Options q_opts(opts);
 		q_opts.add("depth_begin", curr_octree_lvl);
@@ -225,7 +379,10 @@ void qGreyhound::download_bounding_box() const
 		q_opts.add("bounds", bounds.toJson());
 
 		try {
-			download_and_convert_cloud_threaded(cloud, q_opts, converter);
+			// Compressed like the deeper tiles when PDAL has laz-perf
+			const GreyhoundRead read(resource->url().toString().toStdString(), resource->info().schema(), dims);
+			first_color_shift = download_and_convert_tile_threaded(cloud, read, q_opts, bounds, static_cast<int>(curr_octree_lvl), static_cast<int>(curr_octree_lvl) + 1,
+				converter, resource->tile_cache().get(), trace.get());
 		}
 		catch (const std::exception& e) {
 			m_app->dispToConsole(QString("[qGreyhound] %1").arg(e.what()), ccMainAppInterface::ERR_CONSOLE_MESSAGE);
@@ -235,32 +392,84 @@ void qGreyhound::download_bounding_box() const
 		if (cloud->size() == 0) {
 			return;
 		}
+		first_points = cloud->size();
 
+		cloud->add_tiles({ { bounds, static_cast<int>(curr_octree_lvl), static_cast<int>(curr_octree_lvl) + 1, 0, cloud->size() } });
 		cloud->set_bbox(bounds);
 		cloud->set_origin(resource);
-		resource->addChild(cloud);
-		m_app->addToDB(cloud, true);
-		m_app->updateUI();
 		curr_octree_lvl++;
 	}
 
-	GreyhoundDownloader downloader(opts, curr_octree_lvl, bounds, converter);
+	// The cloud is resized while downloading, so it only joins the DB once done.
+	// Meanwhile a preview showing the tiles as they arrive stands in for it.
+	auto preview = new ccPointCloud("Cloud (downloading...)");
+	preview->setGlobalShift(cloud->getGlobalShift());
+	ProgressiveDisplay display(preview);
+	display.stage(*cloud, 0, cloud->size());
+	resource->addChild(preview);
+	display.start(requested_at);
+	m_app->addToDB(preview, true);
+	m_app->updateUI();
+
+	// The user may close the resource while the download runs
+	bool resource_deleted = false;
+	DeletionWatcher resource_watcher([this, &resource_deleted](const ccHObject*) {
+		resource_deleted = true;
+		m_cancel->cancel();
+	});
+	resource_watcher.watch(resource);
+	const QString srs = resource->info().srs();
+
+	GreyhoundDownloader downloader(opts, resource->info().schema(), curr_octree_lvl, bounds, converter);
+	downloader.set_cache(resource->tile_cache());
+	downloader.set_trace(trace);
+	downloader.set_memory_budget(request.budget);
+	downloader.set_stop_criteria(request.stop);
+	downloader.set_tile_callback([&display](const ccPointCloud& c, const unsigned first_index, const unsigned count) {
+		display.stage(c, first_index, count);
+	});
+	m_cancel->reset();
+	downloader.set_cancel_token(m_cancel);
+	m_cancel_download->setEnabled(true);
 	try {
 		QFutureWatcher<void> d;
 		QEventLoop loop;
-		d.setFuture(QtConcurrent::run([&downloader, cloud]() { downloader.download_to(cloud, GreyhoundDownloader::DownloadMethod::DepthByDepth); }));
+		d.setFuture(QtConcurrent::run([&downloader, cloud, method]() { downloader.download_to(cloud, method); }));
 		QObject::connect(&d, &QFutureWatcher<void>::finished, &loop, &QEventLoop::quit);
 		loop.exec();
 		d.waitForFinished();
 	}
 	catch (const std::exception& e) {
 		m_app->dispToConsole(QString("[qGreyhound] %1").arg(e.what()), ccMainAppInterface::ERR_CONSOLE_MESSAGE);
+	}
+	m_cancel_download->setEnabled(false);
+	display.stop();
+	if (display.time_to_first_points() >= 0) {
+		// From the request to the first points on screen, with the other phases of the trace
+		const auto shown_at = requested_at + std::chrono::duration_cast<TileTrace::Clock::duration>(std::chrono::duration<double>(display.time_to_first_points()));
+		trace->record("first_points", requested_at, shown_at, TraceTile());
+	}
+	trace->publish();
+	if (display.preview()) {
+		m_app->removeFromDB(display.preview());
+	}
+	if (resource_deleted) {
+		m_app->dispToConsole("[qGreyhound] The resource was closed during the download, its points were dropped", ccMainAppInterface::WRN_CONSOLE_MESSAGE);
+		delete cloud;
+		m_app->updateUI();
 		return;
 	}
+	resource_watcher.unwatch(resource);
+	cloud->add_tiles(downloader.tiles());
+	// The first depth may have been converted before the color depth settled
+	PDALConverter::recolor(cloud, 0, first_points, first_color_shift, converter.effective_color_shift());
+
+	resource->addChild(cloud);
+	m_app->addToDB(cloud, true);
 	cloud->setName("Cloud");
 	cloud->set_state(ccGreyhoundCloud::State::Idle);
 
-	cloud->setMetaData("LAS.spatialReference.nosave", resource->info().srs());
+	cloud->setMetaData("LAS.spatialReference.nosave", srs);
 	m_app->updateUI();
 }
 
@@ -283,6 +492,10 @@ void qGreyhound::download_more_dimensions(ccGreyhoundCloud *cloud) const
 	for (unsigned int i(0); i < cloud->getNumberOfScalarFields(); ++i) {
 		downloaded.emplace_back(cloud->getScalarField(i)->getName());
 	}
+	// Full colour channels live in the colours, not in scalar fields
+	if (cloud->hasColors()) {
+		downloaded.insert(downloaded.end(), { "Red", "Green", "Blue" });
+	}
 
 	for (const auto& name : available) {
 		if (name == "X" || name == "Y" || name == "Z" || name == "PointId") {
@@ -305,19 +518,12 @@ void qGreyhound::download_more_dimensions(ccGreyhoundCloud *cloud) const
 	}
 
 
-	PDALConverter converter;
-	converter.set_shift(cloud->getGlobalShift());
-	pdal::Options opts;
-	opts.add("url", cloud->origin()->url().toString().toStdString());
-	opts.add("dims", dims);
-	opts.add("bounds", cloud->bbox().toJson());
-
 	cloud->set_state(ccGreyhoundCloud::State::WaitingForPoints);
 	const auto cloud_name = cloud->getName();
 	cloud->setName(cloud_name + " (downloading...)");
 
 	try {
-		download_and_convert_cloud_threaded(cloud, opts, converter);
+		download_dimensions_threaded(cloud, cloud->origin()->url().toString().toStdString(), cloud->origin()->info().schema(), dims);
 	}
 	catch (const std::exception& e) {
 		m_app->dispToConsole(QString("[qGreyhound] %1").arg(e.what()), ccMainAppInterface::ERR_CONSOLE_MESSAGE);
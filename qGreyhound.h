@@ -25,6 +25,8 @@
 
 #include "ccGreyhoundResource.h"
 #include "ccGreyhoundCloud.h"
+#include "CancelToken.h"
+#include "ViewStream.h"
 
 
 class qGreyhound : public QObject, public ccStdPluginInterface
@@ -53,10 +55,19 @@ protected slots:
 
 	void connect_to_resource() const;
 	void download_bounding_box() const;
+	void cancel_download() const;
+	void toggle_view_stream(bool enabled);
 
 protected:
 	QAction* m_download_bounding_box;
 	QAction* m_connect_to_resource;
+	QAction* m_cancel_download;
+	QAction* m_stream_view;
+	// Shared with the running download, if any
+	std::shared_ptr<CancelToken> m_cancel;
+	std::unique_ptr<ViewStream> m_stream;
+	// Used for the /info requests, which never block the GUI
+	QNetworkAccessManager* m_network;
 
 
 	void download_more_dimensions(ccGreyhoundCloud* cloud) const;
@@ -0,0 +1,189 @@
+// Checks every instruction set the cpu supports against the scalar kernels,
+// for all lengths up to twice the widest vector plus one, so that the vector
+// bodies, their tails and the empty case are all exercised.
+
+#include "ConversionKernels.h"
+
+#include <cstdio>
+#include <cstring>
+#include <random>
+#include <vector>
+
+using namespace Kernels;
+
+namespace {
+
+// Elements per AVX-512 register for the narrowest kernel input, 16 bit colors
+const size_t WidestVector = 32;
+const size_t MaxCount = 2 * WidestVector + 1;
+// Written past the end of the outputs, to catch kernels overrunning count
+const uint8_t Canary = 0xA5;
+
+int failures = 0;
+
+void
+fail(const char *kernel, const Isa isa, const size_t count, const char *what)
+{
+	std::printf("FAIL %s %s count=%zu: %s\n", kernel, isa_name(isa), count, what);
+	++failures;
+}
+
+template <typename T>
+std::vector<T>
+with_canary(const size_t count)
+{
+	std::vector<T> out(count + WidestVector);
+	std::memset(out.data(), Canary, out.size() * sizeof(T));
+	return out;
+}
+
+// Bitwise, so that signed zeros and NaN payloads must match too
+template <typename T>
+bool
+same_bits(const std::vector<T>& a, const std::vector<T>& b)
+{
+	return a.size() == b.size() && std::memcmp(a.data(), b.data(), a.size() * sizeof(T)) == 0;
+}
+
+std::vector<Isa>
+vector_isas()
+{
+	std::vector<Isa> isas;
+	for (Isa isa : { Isa::Avx2, Isa::Avx512 }) {
+		if (static_cast<int>(isa) <= static_cast<int>(detected_isa())) {
+			isas.push_back(isa);
+		}
+	}
+	return isas;
+}
+
+// Doubles around a large shift, as for georeferenced coordinates,
+// with a few values a float can't hold and some special ones
+std::vector<double>
+make_doubles(std::mt19937_64& rng, const size_t count, const double around)
+{
+	std::uniform_real_distribution<double> spread(-1e4, 1e4);
+	std::vector<double> in(count);
+	for (size_t i = 0; i < count; ++i) {
+		in[i] = around + spread(rng);
+	}
+	if (count > 3) {
+		in[0] = around;
+		in[1] = -0.0;
+		in[2] = around + 1e40;
+		in[3] = around + 1.0 / 3.0;
+	}
+	return in;
+}
+
+std::vector<uint16_t>
+make_colors(std::mt19937_64& rng, const size_t count, const uint16_t limit)
+{
+	std::uniform_int_distribution<unsigned> channel(0, limit);
+	std::vector<uint16_t> in(count);
+	for (auto& value : in) {
+		value = static_cast<uint16_t>(channel(rng));
+	}
+	return in;
+}
+
+void
+test_shift_and_narrow_xyz(std::mt19937_64& rng, const size_t count)
+{
+	const double shift[3] = { 653000.25, 4852000.5, 120.125 };
+	const std::vector<double> x = make_doubles(rng, count, shift[0]);
+	const std::vector<double> y = make_doubles(rng, count, shift[1]);
+	const std::vector<double> z = make_doubles(rng, count, shift[2]);
+
+	std::vector<float> expected = with_canary<float>(3 * count);
+	set_active_isa(Isa::Scalar);
+	shift_and_narrow_xyz(x.data(), y.data(), z.data(), count, shift, expected.data());
+
+	for (Isa isa : vector_isas()) {
+		std::vector<float> out = with_canary<float>(3 * count);
+		set_active_isa(isa);
+		shift_and_narrow_xyz(x.data(), y.data(), z.data(), count, shift, out.data());
+		if (!same_bits(out, expected)) {
+			fail("shift_and_narrow_xyz", isa, count, "points differ");
+		}
+	}
+}
+
+void
+test_narrow_u16_to_u8(std::mt19937_64& rng, const size_t count)
+{
+	for (uint16_t limit : { uint16_t(0xFF), uint16_t(0xFFFF) }) {
+		for (unsigned shift : { 0u, 8u }) {
+			const std::vector<uint16_t> in = make_colors(rng, count, limit);
+
+			std::vector<uint8_t> expected = with_canary<uint8_t>(count);
+			set_active_isa(Isa::Scalar);
+			narrow_u16_to_u8(in.data(), count, shift, expected.data());
+			std::vector<uint8_t> expected_max_out = with_canary<uint8_t>(count);
+			const uint16_t expected_max = narrow_u16_to_u8_max(in.data(), count, shift, expected_max_out.data());
+			if (!same_bits(expected_max_out, expected)) {
+				fail("narrow_u16_to_u8_max", Isa::Scalar, count, "colors differ from narrow_u16_to_u8");
+			}
+
+			for (Isa isa : vector_isas()) {
+				set_active_isa(isa);
+				std::vector<uint8_t> out = with_canary<uint8_t>(count);
+				narrow_u16_to_u8(in.data(), count, shift, out.data());
+				if (!same_bits(out, expected)) {
+					fail("narrow_u16_to_u8", isa, count, "colors differ");
+				}
+
+				std::vector<uint8_t> max_out = with_canary<uint8_t>(count);
+				const uint16_t max = narrow_u16_to_u8_max(in.data(), count, shift, max_out.data());
+				if (!same_bits(max_out, expected)) {
+					fail("narrow_u16_to_u8_max", isa, count, "colors differ");
+				}
+				if (max != expected_max) {
+					fail("narrow_u16_to_u8_max", isa, count, "maximum differs");
+				}
+			}
+		}
+	}
+}
+
+void
+test_shift_and_narrow(std::mt19937_64& rng, const size_t count)
+{
+	const double shift = 1.2e9;
+	const std::vector<double> in = make_doubles(rng, count, shift);
+
+	std::vector<float> expected = with_canary<float>(count);
+	set_active_isa(Isa::Scalar);
+	shift_and_narrow(in.data(), count, shift, expected.data());
+
+	for (Isa isa : vector_isas()) {
+		std::vector<float> out = with_canary<float>(count);
+		set_active_isa(isa);
+		shift_and_narrow(in.data(), count, shift, out.data());
+		if (!same_bits(out, expected)) {
+			fail("shift_and_narrow", isa, count, "values differ");
+		}
+	}
+}
+
+}
+
+int
+main()
+{
+	std::printf("detected %s\n", isa_name(detected_isa()));
+
+	std::mt19937_64 rng(20181017);
+	for (size_t count = 0; count <= MaxCount; ++count) {
+		test_shift_and_narrow_xyz(rng, count);
+		test_narrow_u16_to_u8(rng, count);
+		test_shift_and_narrow(rng, count);
+	}
+
+	if (failures) {
+		std::printf("%d failures\n", failures);
+		return 1;
+	}
+	std::printf("all kernels match the scalar versions\n");
+	return 0;
+}